@@ -0,0 +1,121 @@
+/**
+ * @file adaptive_mutex.h
+ *
+ * This file contains a declaration of AdaptiveMutex, a mutex which spins for about as long as it is usually held,
+ * then parks on futex.
+ */
+
+#ifndef CXXUTIL_ADAPTIVE_MUTEX_H_
+#define CXXUTIL_ADAPTIVE_MUTEX_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "futex.h"
+#include "spinlock.h"
+
+/**
+ * @brief Spin-then-park mutex with a spin budget learned from hold times
+ *
+ * Every kSampleInterval-th acquisition is timed from Lock to Unlock and folded into an exponential moving average.
+ * A contended Lock spins for twice that average (at most kMaxSpinNs), since the holder is likely to leave within
+ * that time, then parks on futex. When holds are longer than a futex round trip, waiters park without spinning.
+ *
+ * Same interface as SpinLock, use with AdaptiveMutexGuard.
+ */
+class AdaptiveMutex {
+ public:
+  /// Holds sampled once every kSampleInterval acquisitions, power of 2
+  static constexpr uint32_t kSampleInterval = 8;
+  /// Upper bound of the spin phase
+  static constexpr int64_t kMaxSpinNs = 50000;
+  /// Holds expected longer than this are not worth spinning for, roughly the cost of a sleep and wake up
+  static constexpr int64_t kParkThresholdNs = 20000;
+
+  AdaptiveMutex() noexcept = default;
+
+  void Lock() {
+    if (!TryLock()) LockSlow();
+    if ((++acquire_count_ & (kSampleInterval - 1)) == 0) {
+      hold_start_ = Now();
+    } else {
+      hold_start_ = 0;
+    }
+  }
+
+  bool TryLock() {
+    int expected = kUnlocked;
+    return state_.load(std::memory_order_relaxed) == kUnlocked &&
+           state_.compare_exchange_strong(expected, kLocked, std::memory_order_acquire, std::memory_order_relaxed);
+  }
+
+  void Unlock() {
+    // cleared here too, an acquisition by TryLock does not set it
+    if (hold_start_) {
+      Sample(Now() - hold_start_);
+      hold_start_ = 0;
+    }
+    if (state_.exchange(kUnlocked, std::memory_order_release) == kContended) FutexWake(&state_, 1);
+  }
+
+  bool IsLocked() const { return state_.load(std::memory_order_acquire) != kUnlocked; }
+
+  /**
+   * @brief Current estimate of hold time in nanoseconds
+   */
+  int64_t ExpectedHoldNs() const { return avg_hold_ns_.load(std::memory_order_relaxed); }
+
+ private:
+  static constexpr int kUnlocked = 0;
+  static constexpr int kLocked = 1;
+  static constexpr int kContended = 2;
+  // weight of a new sample in the moving average is 1 / 2^kEmaShift
+  static constexpr int kEmaShift = 3;
+  // clock is read once per this many spins
+  static constexpr uint32_t kClockStride = 32;
+
+  static int64_t Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  void LockSlow() {
+    int64_t expected_hold = avg_hold_ns_.load(std::memory_order_relaxed);
+    if (expected_hold < kParkThresholdNs) {
+      int64_t deadline = Now() + std::min(2 * expected_hold, kMaxSpinNs);
+      for (uint32_t spin_count = 1;; ++spin_count) {
+        if (state_.load(std::memory_order_relaxed) == kUnlocked && TryLock()) return;
+        if (spin_count % kClockStride == 0 && Now() >= deadline) break;
+        CpuRelax();
+      }
+    }
+    while (state_.exchange(kContended, std::memory_order_acquire) != kUnlocked) {
+      FutexWait(&state_, kContended);
+    }
+  }
+
+  // called by the holder, only the average itself is read by other threads
+  void Sample(int64_t hold_ns) {
+    // a single long hold (I/O) should not turn off spinning for the short ones that follow
+    hold_ns = std::min(hold_ns, kMaxSpinNs);
+    int64_t avg = avg_hold_ns_.load(std::memory_order_relaxed);
+    avg_hold_ns_.store(avg + ((hold_ns - avg) >> kEmaShift), std::memory_order_relaxed);
+  }
+
+  AdaptiveMutex(const AdaptiveMutex&) = delete;
+  AdaptiveMutex& operator=(const AdaptiveMutex&) = delete;
+
+  std::atomic<int> state_{kUnlocked};
+  // a short critical section until the first samples come in
+  std::atomic<int64_t> avg_hold_ns_{1000};
+  // written by the holder only
+  uint32_t acquire_count_ = 0;
+  int64_t hold_start_ = 0;
+};  // AdaptiveMutex
+
+using AdaptiveMutexGuard = BasicSpinLockGuard<AdaptiveMutex>;
+
+#endif  // CXXUTIL_ADAPTIVE_MUTEX_H_
@@ -36,9 +36,14 @@
 #ifndef EDK_ANY_HPP
 #define EDK_ANY_HPP
 #pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
 #include <stdexcept>
 #include <type_traits>
 #include <typeinfo>
+#include <utility>
 
 #if defined(PARTICLE)
 #if !defined(__cpp_exceptions) && !defined(ANY_IMPL_NO_EXCEPTIONS) && !defined(ANY_IMPL_EXCEPTIONS)
@@ -63,13 +68,69 @@ class bad_any_cast : public std::bad_cast {
   const char* what() const noexcept override { return "bad any cast"; }
 };
 
-class any final {
+#if defined(_MSC_VER)
+#define ANY_IMPL_TYPE_SIGNATURE __FUNCSIG__
+#else
+#define ANY_IMPL_TYPE_SIGNATURE __PRETTY_FUNCTION__
+#endif
+
+namespace detail {
+/// Type identity that needs no RTTI and holds across shared libraries.
+///
+/// signature() spells T out, e.g. "... any_type_id<T>::signature() [with T = OneItem]", the same text in every
+/// library built by the same compiler. hash() is its FNV-1a, computed at compile time, so comparing it is as cheap as
+/// comparing pointers, and only equal hashes need the string comparison.
+/// Types without linkage (in an anonymous namespace, local classes, lambdas) can be spelled alike in two translation
+/// units of one program, has_linkage() is false for them and for templates of them, they are told apart by the
+/// vtable pointer only and do not cross library boundaries in an any.
+template <typename T>
+struct any_type_id {
+  static constexpr const char* signature() noexcept { return ANY_IMPL_TYPE_SIGNATURE; }
+
+  static constexpr bool has_linkage() noexcept {
+    // spelled "{anonymous}" by gcc, "(anonymous namespace)" by clang, "`anonymous namespace'" by msvc,
+    // a local class is "f()::Local"
+    return !contains("anonymous") && !contains("lambda") && !contains("unnamed") && !contains(")::");
+  }
+
+  static constexpr uint64_t hash() noexcept {
+    uint64_t h = 14695981039346656037ull;
+    for (const char* p = signature(); *p; ++p) {
+      h ^= static_cast<unsigned char>(*p);
+      h *= 1099511628211ull;
+    }
+    return h;
+  }
+
+ private:
+  static constexpr bool contains(const char* word) noexcept {
+    for (const char* p = signature(); *p; ++p) {
+      const char* a = p;
+      const char* b = word;
+      while (*b && *a == *b) {
+        ++a;
+        ++b;
+      }
+      if (!*b) return true;
+    }
+    return false;
+  }
+};
+}  // namespace detail
+
+/// Values of at most N bytes, aligned to at most Align, with a nothrow move constructor are stored inline,
+/// others are allocated with Alloc rebound to their type. Alloc must be stateless, e.g. std::allocator or
+/// PoolAllocator from pool_allocator.h. Objects of different instantiations do not convert to each other.
+template <std::size_t N = 2 * sizeof(void*), std::size_t Align = alignof(void*), typename Alloc = std::allocator<char>>
+class basic_any final {
+  static_assert(std::allocator_traits<Alloc>::is_always_equal::value, "basic_any requires a stateless allocator");
+
  public:
   /// Constructs an object of type any with an empty state.
-  any() : vtable(nullptr) {}
+  basic_any() : vtable(nullptr) {}
 
   /// Constructs an object of type any with an equivalent state as other.
-  any(const any& rhs) : vtable(rhs.vtable) {
+  basic_any(const basic_any& rhs) : vtable(rhs.vtable) {
     if (!rhs.empty()) {
       rhs.vtable->copy(rhs.storage, this->storage);
     }
@@ -77,7 +138,7 @@ class any final {
 
   /// Constructs an object of type any with a state equivalent to the original state of other.
   /// rhs is left in a valid but otherwise unspecified state.
-  any(any&& rhs) noexcept : vtable(rhs.vtable) {
+  basic_any(basic_any&& rhs) noexcept : vtable(rhs.vtable) {
     if (!rhs.empty()) {
       rhs.vtable->move(rhs.storage, this->storage);
       rhs.vtable = nullptr;
@@ -85,7 +146,7 @@ class any final {
   }
 
   /// Same effect as this->clear().
-  ~any() { this->clear(); }
+  ~basic_any() { this->clear(); }
 
   /// Constructs an object of type any that contains an object of type T direct-initialized with
   /// std::forward<ValueType>(value).
@@ -94,16 +155,16 @@ class any final {
   /// This is because an `any` may be copy constructed into another `any` at any time, so a copy should always be
   /// allowed.
   template <typename ValueType,
-            typename = typename std::enable_if<!std::is_same<typename std::decay<ValueType>::type, any>::value>::type>
-  any(ValueType&& value) {
+            typename = typename std::enable_if<!std::is_same<typename std::decay<ValueType>::type, basic_any>::value>::type>
+  basic_any(ValueType&& value) {
     static_assert(std::is_copy_constructible<typename std::decay<ValueType>::type>::value,
                   "T shall satisfy the CopyConstructible requirements.");
     this->construct(std::forward<ValueType>(value));
   }
 
   /// Has the same effect as any(rhs).swap(*this). No effects if an exception is thrown.
-  any& operator=(const any& rhs) {
-    any(rhs).swap(*this);
+  basic_any& operator=(const basic_any& rhs) {
+    basic_any(rhs).swap(*this);
     return *this;
   }
 
@@ -111,8 +172,8 @@ class any final {
   ///
   /// The state of *this is equivalent to the original state of rhs and rhs is left in a valid
   /// but otherwise unspecified state.
-  any& operator=(any&& rhs) noexcept {
-    any(std::move(rhs)).swap(*this);
+  basic_any& operator=(basic_any&& rhs) noexcept {
+    basic_any(std::move(rhs)).swap(*this);
     return *this;
   }
 
@@ -122,11 +183,11 @@ class any final {
   /// This is because an `any` may be copy constructed into another `any` at any time, so a copy should always be
   /// allowed.
   template <typename ValueType,
-            typename = typename std::enable_if<!std::is_same<typename std::decay<ValueType>::type, any>::value>::type>
-  any& operator=(ValueType&& value) {
+            typename = typename std::enable_if<!std::is_same<typename std::decay<ValueType>::type, basic_any>::value>::type>
+  basic_any& operator=(ValueType&& value) {
     static_assert(std::is_copy_constructible<typename std::decay<ValueType>::type>::value,
                   "T shall satisfy the CopyConstructible requirements.");
-    any(std::forward<ValueType>(value)).swap(*this);
+    basic_any(std::forward<ValueType>(value)).swap(*this);
     return *this;
   }
 
@@ -147,9 +208,9 @@ class any final {
 #endif
 
   /// Exchange the states of *this and rhs.
-  void swap(any& rhs) noexcept {
+  void swap(basic_any& rhs) noexcept {
     if (this->vtable != rhs.vtable) {
-      any tmp(std::move(rhs));
+      basic_any tmp(std::move(rhs));
 
       // move from *this to rhs.
       rhs.vtable = this->vtable;
@@ -172,10 +233,10 @@ class any final {
 
  private:  // Storage and Virtual Method Table
   union storage_union {
-    using stack_storage_t = typename std::aligned_storage<2 * sizeof(void*), std::alignment_of<void*>::value>::type;
+    using stack_storage_t = typename std::aligned_storage<N, Align>::type;
 
     void* dynamic;
-    stack_storage_t stack;  // 2 words for e.g. shared_ptr
+    stack_storage_t stack;  // 2 words by default, for e.g. shared_ptr
   };
 
   /// Base VTable specification.
@@ -188,6 +249,10 @@ class any final {
     const std::type_info& (*type)() noexcept;
 #endif
 
+    /// detail::any_type_id of the type, compared when the vtable pointers differ.
+    uint64_t type_hash;
+    const char* (*type_signature)() noexcept;
+
     /// Destroys the object in the union.
     /// The state of the union after this call is unspecified, caller must ensure not to use src anymore.
     void (*destroy)(storage_union&) noexcept;
@@ -207,17 +272,40 @@ class any final {
   /// VTable for dynamically allocated storage.
   template <typename T>
   struct vtable_dynamic {
+    using allocator_type = typename std::allocator_traits<Alloc>::template rebind_alloc<T>;
+    using allocator_traits = std::allocator_traits<allocator_type>;
+
 #ifndef ANY_IMPL_NO_RTTI
     static const std::type_info& type() noexcept { return typeid(T); }
 #endif
 
+    template <typename... Args>
+    static T* create(Args&&... args) {
+      allocator_type alloc;
+      T* p = allocator_traits::allocate(alloc, 1);
+#ifndef ANY_IMPL_NO_EXCEPTIONS
+      try {
+        allocator_traits::construct(alloc, p, std::forward<Args>(args)...);
+      } catch (...) {
+        allocator_traits::deallocate(alloc, p, 1);
+        throw;
+      }
+#else
+      allocator_traits::construct(alloc, p, std::forward<Args>(args)...);
+#endif
+      return p;
+    }
+
     static void destroy(storage_union& storage) noexcept {
       // assert(reinterpret_cast<T*>(storage.dynamic));
-      delete reinterpret_cast<T*>(storage.dynamic);
+      allocator_type alloc;
+      T* p = reinterpret_cast<T*>(storage.dynamic);
+      allocator_traits::destroy(alloc, p);
+      allocator_traits::deallocate(alloc, p, 1);
     }
 
     static void copy(const storage_union& src, storage_union& dest) {
-      dest.dynamic = new T(*reinterpret_cast<const T*>(src.dynamic));
+      dest.dynamic = create(*reinterpret_cast<const T*>(src.dynamic));
     }
 
     static void move(storage_union& src, storage_union& dest) noexcept {
@@ -264,29 +352,46 @@ class any final {
   struct requires_allocation
       : std::integral_constant<bool,
                                !(std::is_nothrow_move_constructible<T>::value  // N4562 §6.3/3 [any.class]
-                                 && sizeof(T) <= sizeof(storage_union::stack) &&
+                                 && sizeof(T) <= sizeof(typename storage_union::stack_storage_t) &&
                                  std::alignment_of<T>::value <=
-                                     std::alignment_of<storage_union::stack_storage_t>::value)> {};
+                                     std::alignment_of<typename storage_union::stack_storage_t>::value)> {};
 
   /// Returns the pointer to the vtable of the type T.
   template <typename T>
   static vtable_type* vtable_for_type() {
     using VTableType =
         typename std::conditional<requires_allocation<T>::value, vtable_dynamic<T>, vtable_stack<T>>::type;
+    // constant initialized, no guard is checked on the any_cast path
+    static constexpr uint64_t kTypeHash = detail::any_type_id<T>::hash();
     static vtable_type table = {
 #ifndef ANY_IMPL_NO_RTTI
         VTableType::type,
 #endif
+        kTypeHash, detail::any_type_id<T>::signature,
         VTableType::destroy, VTableType::copy, VTableType::move, VTableType::swap,
     };
     return &table;
   }
 
- protected:
-  template <typename T>
-  friend const T* any_cast(const any* operand) noexcept;
+  /// Whether the contained object is of type T.
+  ///
+  /// The vtable of T is usually one object in the whole process, then this is a single pointer comparison.
+  /// A shared library built with hidden visibility, or loaded with RTLD_LOCAL, has its own copy, an any created there
+  /// is then recognized by the type hash and signature, for types with linkage only.
   template <typename T>
-  friend T* any_cast(any* operand) noexcept;
+  bool holds() const noexcept {
+    const vtable_type* expected = vtable_for_type<T>();
+    if (this->vtable == expected) return true;
+    if (!detail::any_type_id<T>::has_linkage()) return false;
+    return this->vtable != nullptr && this->vtable->type_hash == expected->type_hash &&
+           std::strcmp(this->vtable->type_signature(), expected->type_signature()) == 0;
+  }
+
+ protected:
+  template <typename T, std::size_t N2, std::size_t Align2, typename Alloc2>
+  friend const T* any_cast(const basic_any<N2, Align2, Alloc2>* operand) noexcept;
+  template <typename T, std::size_t N2, std::size_t Align2, typename Alloc2>
+  friend T* any_cast(basic_any<N2, Align2, Alloc2>* operand) noexcept;
 
   /// Casts (with no type_info checks) the storage pointer as const T*.
   template <typename T>
@@ -308,7 +413,7 @@ class any final {
 
   template <typename ValueType, typename T>
   typename std::enable_if<requires_allocation<T>::value>::type do_construct(ValueType&& value) {
-    storage.dynamic = new T(std::forward<ValueType>(value));
+    storage.dynamic = vtable_dynamic<T>::create(std::forward<ValueType>(value));
   }
 
   template <typename ValueType, typename T>
@@ -328,6 +433,9 @@ class any final {
   }
 };
 
+/// The original any, inline storage of 2 pointers, dynamic storage from new / delete
+using any = basic_any<>;
+
 namespace detail {
 template <typename ValueType>
 inline ValueType any_cast_move_if_true(typename std::remove_reference<ValueType>::type* p, std::true_type) {
@@ -341,8 +449,8 @@ inline ValueType any_cast_move_if_true(typename std::remove_reference<ValueType>
 }  // namespace detail
 
 /// Performs *any_cast<add_const_t<remove_reference_t<ValueType>>>(&operand), or throws bad_any_cast on failure.
-template <typename ValueType>
-inline ValueType any_cast(const any& operand) {
+template <typename ValueType, std::size_t N, std::size_t Align, typename Alloc>
+inline ValueType any_cast(const basic_any<N, Align, Alloc>& operand) {
   auto p = any_cast<typename std::add_const<typename std::remove_reference<ValueType>::type>::type>(&operand);
 #ifndef ANY_IMPL_NO_EXCEPTIONS
   if (p == nullptr) throw bad_any_cast();
@@ -351,8 +459,8 @@ inline ValueType any_cast(const any& operand) {
 }
 
 /// Performs *any_cast<remove_reference_t<ValueType>>(&operand), or throws bad_any_cast on failure.
-template <typename ValueType>
-inline ValueType any_cast(any& operand) {
+template <typename ValueType, std::size_t N, std::size_t Align, typename Alloc>
+inline ValueType any_cast(basic_any<N, Align, Alloc>& operand) {
   auto p = any_cast<typename std::remove_reference<ValueType>::type>(&operand);
 #ifndef ANY_IMPL_NO_EXCEPTIONS
   if (p == nullptr) throw bad_any_cast();
@@ -365,8 +473,8 @@ inline ValueType any_cast(any& operand) {
 /// std::move(*any_cast<remove_reference_t<ValueType>>(&operand)), otherwise
 /// *any_cast<remove_reference_t<ValueType>>(&operand). Throws bad_any_cast on failure.
 ///
-template <typename ValueType>
-inline ValueType any_cast(any&& operand) {
+template <typename ValueType, std::size_t N, std::size_t Align, typename Alloc>
+inline ValueType any_cast(basic_any<N, Align, Alloc>&& operand) {
   using can_move = std::integral_constant<bool, std::is_move_constructible<ValueType>::value &&
                                                     !std::is_lvalue_reference<ValueType>::value>;
 
@@ -377,32 +485,52 @@ inline ValueType any_cast(any&& operand) {
   return detail::any_cast_move_if_true<ValueType>(p, can_move());
 }
 
-/// If operand != nullptr && operand->type() == typeid(ValueType), a pointer to the object
-/// contained by operand, otherwise nullptr.
+// Overloads for the default any, template deduction of the ones above does not look through conversions,
+// these keep `any_cast<T>(value)` working with a value that converts to any.
 template <typename ValueType>
-inline const ValueType* any_cast(const any* operand) noexcept {
+inline ValueType any_cast(const any& operand) {
+  return any_cast<ValueType, 2 * sizeof(void*), alignof(void*), std::allocator<char>>(operand);
+}
+
+template <typename ValueType>
+inline ValueType any_cast(any& operand) {
+  return any_cast<ValueType, 2 * sizeof(void*), alignof(void*), std::allocator<char>>(operand);
+}
+
+template <typename ValueType>
+inline ValueType any_cast(any&& operand) {
+  return any_cast<ValueType, 2 * sizeof(void*), alignof(void*), std::allocator<char>>(std::move(operand));
+}
+
+/// If operand != nullptr && operand holds a ValueType, a pointer to the object
+/// contained by operand, otherwise nullptr. Needs no RTTI.
+template <typename ValueType, std::size_t N, std::size_t Align, typename Alloc>
+inline const ValueType* any_cast(const basic_any<N, Align, Alloc>* operand) noexcept {
   using T = typename std::decay<ValueType>::type;
 
-  if (operand && operand->vtable == any::vtable_for_type<T>())
-    return operand->cast<ValueType>();
+  if (operand && operand->template holds<T>())
+    return operand->template cast<ValueType>();
   else
     return nullptr;
 }
 
-/// If operand != nullptr && operand->type() == typeid(ValueType), a pointer to the object
-/// contained by operand, otherwise nullptr.
-template <typename ValueType>
-inline ValueType* any_cast(any* operand) noexcept {
+/// If operand != nullptr && operand holds a ValueType, a pointer to the object
+/// contained by operand, otherwise nullptr. Needs no RTTI.
+template <typename ValueType, std::size_t N, std::size_t Align, typename Alloc>
+inline ValueType* any_cast(basic_any<N, Align, Alloc>* operand) noexcept {
   using T = typename std::decay<ValueType>::type;
 
-  if (operand && operand->vtable == any::vtable_for_type<T>())
-    return operand->cast<ValueType>();
+  if (operand && operand->template holds<T>())
+    return operand->template cast<ValueType>();
   else
     return nullptr;
 }
 
 namespace std {
-inline void swap(any& lhs, any& rhs) noexcept { lhs.swap(rhs); }
+template <std::size_t N, std::size_t Align, typename Alloc>
+inline void swap(basic_any<N, Align, Alloc>& lhs, basic_any<N, Align, Alloc>& rhs) noexcept {
+  lhs.swap(rhs);
+}
 }  // namespace std
 
 #endif
@@ -0,0 +1,124 @@
+#include "async_downloader.h"
+
+#include <utility>
+
+AsyncDownloader::AsyncDownloader(const std::string& model_dir, size_t thread_num)
+    : model_dir_(model_dir),
+      own_pool_(new EqualityThreadPool(nullptr, static_cast<int>(thread_num ? thread_num : 1))),
+      pool_(own_pool_.get()) {
+  // before any pool thread makes a handle, older libcurl does not initialize itself thread-safely
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+}
+
+AsyncDownloader::AsyncDownloader(const std::string& model_dir, EqualityThreadPool* pool)
+    : model_dir_(model_dir), pool_(pool) {
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+}
+
+AsyncDownloader::~AsyncDownloader() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_cv_.wait(lock, [this] { return running_ == 0; });
+  idle_downloaders_.clear();
+  curl_global_cleanup();
+}
+
+size_t AsyncDownloader::GetInflightNum() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return inflight_.size();
+}
+
+std::shared_future<DownloadResult> AsyncDownloader::DownloadAsync(const std::string& url, DownloadCallback on_done) {
+  const std::string file_path = CurlDownloader::GetFilePath(model_dir_, url);
+  std::shared_ptr<Request> request;
+  std::string other_url;
+  bool first = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::shared_ptr<Request>& slot = inflight_[file_path];
+    if (!slot) {
+      slot = std::make_shared<Request>();
+      slot->url = url;
+      slot->file_path = file_path;
+      slot->future = slot->promise.get_future().share();
+      first = true;
+      ++running_;
+    }
+    if (slot->url == url) {
+      if (on_done) slot->callbacks.push_back(std::move(on_done));
+      request = slot;
+    } else {
+      other_url = slot->url;
+    }
+  }
+
+  if (!request) {
+    // two transfers of one file would corrupt it
+    DownloadResult result;
+    result.url = url;
+    result.code = CURLE_WRITE_ERROR;
+    result.error = file_path + " is being downloaded from " + other_url;
+    std::promise<DownloadResult> promise;
+    promise.set_value(result);
+    if (on_done) on_done(result);
+    return promise.get_future().share();
+  }
+  if (first) pool_->VoidPush(0, [this, request]() { Run(request); });
+  return request->future;
+}
+
+std::unique_ptr<CurlDownloader> AsyncDownloader::AcquireDownloader() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!idle_downloaders_.empty()) {
+      std::unique_ptr<CurlDownloader> downloader = std::move(idle_downloaders_.back());
+      idle_downloaders_.pop_back();
+      return downloader;
+    }
+  }
+  // one transfer per downloader, the concurrency comes from the pool
+  return std::unique_ptr<CurlDownloader>(new CurlDownloader(model_dir_, 1));
+}
+
+void AsyncDownloader::ReleaseDownloader(std::unique_ptr<CurlDownloader> downloader) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  idle_downloaders_.push_back(std::move(downloader));
+}
+
+void AsyncDownloader::Run(const std::shared_ptr<Request>& request) {
+  const std::string& url = request->url;
+  DownloadResult result;
+  bool failed = false;
+  try {
+    std::unique_ptr<CurlDownloader> downloader = AcquireDownloader();
+    if (segmented_) {
+      // a segmented download spreads over several connections, let it
+      downloader->SetMaxConcurrency(CurlDownloader::kDefaultMaxConcurrency);
+      result = downloader->DownloadSegmented(url);
+      downloader->SetMaxConcurrency(1);
+    } else {
+      result = downloader->DownloadBatch({url})[0];
+    }
+    ReleaseDownloader(std::move(downloader));
+  } catch (...) {
+    failed = true;
+  }
+
+  // later requests for url start a new transfer, which finds the file complete
+  std::vector<DownloadCallback> callbacks;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    inflight_.erase(request->file_path);
+    callbacks.swap(request->callbacks);
+  }
+  if (failed) {
+    result.url = url;
+    result.code = CURLE_FAILED_INIT;
+    result.error = "download aborted by an exception";
+  }
+  request->promise.set_value(result);
+  for (const DownloadCallback& callback : callbacks) callback(result);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  --running_;
+  done_cv_.notify_all();
+}
@@ -0,0 +1,98 @@
+/**
+ * @file async_downloader.h
+ *
+ * This file contains a declaration of AsyncDownloader, which runs CurlDownloader transfers on a ThreadPool and hands
+ * back futures.
+ */
+
+#ifndef CXXUTIL_ASYNC_DOWNLOADER_H_
+#define CXXUTIL_ASYNC_DOWNLOADER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "curl_downloader.h"
+#include "thread_pool.h"
+
+/**
+ * @brief Non-blocking front of CurlDownloader, so downloads overlap with the rest of initialization
+ *
+ * Each DownloadAsync returns at once with a future of the result and, optionally, calls a callback on a pool thread
+ * when it is done. Failures, a bad model_dir included, come back as a DownloadResult with an error, never by exiting.
+ * Requests for a url already in flight join that transfer instead of starting another one. A request for another url
+ * of the same file name as a transfer in flight fails at once, see CurlDownloader::GetFilePath.
+ *
+ * Transfers run on a ThreadPool, owned or shared with other users. Every pool thread running a transfer uses its own
+ * CurlDownloader, taken from a pool of them, so connections are kept between downloads. Thread-safe.
+ */
+class AsyncDownloader {
+ public:
+  static constexpr size_t kDefaultThreadNum = 4;
+
+  /**
+   * @brief Runs the transfers on an own pool of thread_num threads
+   */
+  explicit AsyncDownloader(const std::string& model_dir, size_t thread_num = kDefaultThreadNum);
+  /**
+   * @brief Runs the transfers on pool, which must outlive this downloader
+   */
+  AsyncDownloader(const std::string& model_dir, EqualityThreadPool* pool);
+  // waits for the transfers in flight
+  ~AsyncDownloader();
+
+  AsyncDownloader(const AsyncDownloader&) = delete;
+  AsyncDownloader& operator=(const AsyncDownloader&) = delete;
+
+  /**
+   * @brief Starts downloading url into model_dir, or joins the transfer of url in flight
+   *
+   * on_done, when set, is called once with the result on the thread that finished the transfer, or in the calling
+   * thread if the request fails at once.
+   */
+  std::shared_future<DownloadResult> DownloadAsync(const std::string& url, DownloadCallback on_done = nullptr);
+
+  /**
+   * @brief Large files are fetched as parallel Range requests, see CurlDownloader::DownloadSegmented. Off by default
+   */
+  void SetSegmented(bool segmented) { segmented_ = segmented; }
+
+  // transfers in flight, requests joined to another one are not counted
+  size_t GetInflightNum() const;
+
+ private:
+  struct Request {
+    std::string url;
+    std::string file_path;
+    std::promise<DownloadResult> promise;
+    std::shared_future<DownloadResult> future;
+    std::vector<DownloadCallback> callbacks;
+  };
+
+  void Run(const std::shared_ptr<Request>& request);
+  std::unique_ptr<CurlDownloader> AcquireDownloader();
+  void ReleaseDownloader(std::unique_ptr<CurlDownloader> downloader);
+
+  std::string model_dir_;
+  std::atomic<bool> segmented_{false};
+
+  mutable std::mutex mutex_;
+  std::condition_variable done_cv_;
+  // file path -> transfer in flight, keyed by path so two urls never write one file at once
+  std::unordered_map<std::string, std::shared_ptr<Request>> inflight_;
+  // tasks pushed to the pool and not finished, the destructor waits for 0
+  size_t running_ = 0;
+  std::vector<std::unique_ptr<CurlDownloader>> idle_downloaders_;
+
+  // declared last, an owned pool is joined before the rest is destroyed
+  std::unique_ptr<EqualityThreadPool> own_pool_;
+  EqualityThreadPool* pool_;
+};  // AsyncDownloader
+
+#endif  // CXXUTIL_ASYNC_DOWNLOADER_H_
@@ -0,0 +1,130 @@
+#include <benchmark/benchmark.h>
+
+#include <any>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "any.h"
+#include "pool_allocator.h"
+
+// trivially copyable value of Size bytes, stands for a payload type
+template <size_t Size>
+struct AnyPayload {
+  uint64_t words[Size / sizeof(uint64_t)];
+};
+
+// the N passed to basic_any is a buffer size, this gives one of 8 words
+using WideAny = basic_any<8 * sizeof(void*)>;
+using PooledAny = basic_any<2 * sizeof(void*), alignof(void*), PoolAllocator<char>>;
+
+// construct from a payload and destroy
+template <typename Any, size_t Size>
+struct AnyConstruct {
+  static void Run(benchmark::State& state) {
+    AnyPayload<Size> payload{};
+    for (auto _ : state) {
+      Any a(payload);
+      benchmark::DoNotOptimize(&a);
+    }
+  }
+};
+
+// copy an existing any and destroy the copy
+template <typename Any, size_t Size>
+struct AnyCopy {
+  static void Run(benchmark::State& state) {
+    Any src(AnyPayload<Size>{});
+    for (auto _ : state) {
+      Any a(src);
+      benchmark::DoNotOptimize(&a);
+    }
+  }
+};
+
+// fill a batch of kBatch values and drop them, allocation and free order as in a pipeline queue
+template <typename Any, size_t Size>
+struct AnyBatch {
+  static void Run(benchmark::State& state) {
+    constexpr size_t kBatch = 64;
+    std::vector<Any> batch;
+    batch.reserve(kBatch);
+    AnyPayload<Size> payload{};
+    for (auto _ : state) {
+      for (size_t i = 0; i < kBatch; ++i) batch.emplace_back(payload);
+      benchmark::DoNotOptimize(batch.data());
+      batch.clear();
+    }
+    state.SetItemsProcessed(state.iterations() * kBatch);
+  }
+};
+
+// range(0) is the payload size in bytes
+template <template <typename, size_t> class Op, typename Any>
+static void bench_any(benchmark::State& state) {
+  switch (state.range(0)) {
+    case 8: return Op<Any, 8>::Run(state);
+    case 16: return Op<Any, 16>::Run(state);
+    case 32: return Op<Any, 32>::Run(state);
+    case 64: return Op<Any, 64>::Run(state);
+    case 128: return Op<Any, 128>::Run(state);
+    case 256: return Op<Any, 256>::Run(state);
+    default: state.SkipWithError("unsupported payload size");
+  }
+}
+
+static void AnyPayloadArgs(benchmark::internal::Benchmark* b) {
+  b->ArgName("bytes");
+  b->RangeMultiplier(2)->Range(8, 256);
+}
+
+BENCHMARK_TEMPLATE(bench_any, AnyConstruct, any)->Apply(AnyPayloadArgs);
+BENCHMARK_TEMPLATE(bench_any, AnyConstruct, WideAny)->Apply(AnyPayloadArgs);
+BENCHMARK_TEMPLATE(bench_any, AnyConstruct, PooledAny)->Apply(AnyPayloadArgs);
+BENCHMARK_TEMPLATE(bench_any, AnyConstruct, std::any)->Apply(AnyPayloadArgs);
+BENCHMARK_TEMPLATE(bench_any, AnyCopy, any)->Apply(AnyPayloadArgs);
+BENCHMARK_TEMPLATE(bench_any, AnyCopy, WideAny)->Apply(AnyPayloadArgs);
+BENCHMARK_TEMPLATE(bench_any, AnyCopy, PooledAny)->Apply(AnyPayloadArgs);
+BENCHMARK_TEMPLATE(bench_any, AnyCopy, std::any)->Apply(AnyPayloadArgs);
+BENCHMARK_TEMPLATE(bench_any, AnyBatch, any)->Apply(AnyPayloadArgs);
+BENCHMARK_TEMPLATE(bench_any, AnyBatch, WideAny)->Apply(AnyPayloadArgs);
+BENCHMARK_TEMPLATE(bench_any, AnyBatch, PooledAny)->Apply(AnyPayloadArgs);
+BENCHMARK_TEMPLATE(bench_any, AnyBatch, std::any)->Apply(AnyPayloadArgs);
+
+// any_cast to the held type, and to another type; std::any_cast is found by ADL for std::any
+template <typename Any>
+static void bench_any_cast_hit(benchmark::State& state) {
+  Any a(42);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(a);
+    benchmark::DoNotOptimize(any_cast<int>(&a));
+  }
+}
+
+BENCHMARK_TEMPLATE(bench_any_cast_hit, any);
+BENCHMARK_TEMPLATE(bench_any_cast_hit, std::any);
+
+template <typename Any>
+static void bench_any_cast_miss(benchmark::State& state) {
+  Any a(42);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(a);
+    benchmark::DoNotOptimize(any_cast<double>(&a));
+  }
+}
+
+BENCHMARK_TEMPLATE(bench_any_cast_miss, any);
+BENCHMARK_TEMPLATE(bench_any_cast_miss, std::any);
+
+#ifndef ANY_IMPL_NO_RTTI
+// identity through std::type_info, what a type() check before the cast costs
+static void bench_any_typeid_check(benchmark::State& state) {
+  any a(42);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(a);
+    benchmark::DoNotOptimize(a.type() == typeid(int));
+  }
+}
+
+BENCHMARK(bench_any_typeid_check);
+#endif
@@ -0,0 +1,75 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "flat_map.h"
+
+inline void MakeMapKey(int i, int64_t* key) { *key = static_cast<int64_t>(i) * 7919; }
+inline void MakeMapKey(int i, std::string* key) { *key = "stream/param/" + std::to_string(i); }
+
+// range(0) distinct pairs in random order, the way parameters arrive from a config
+template <typename Key>
+static std::vector<std::pair<Key, int>> MakeMapItems(int n) {
+  std::vector<std::pair<Key, int>> items(n);
+  for (int i = 0; i < n; ++i) {
+    MakeMapKey(i, &items[i].first);
+    items[i].second = i;
+  }
+  std::shuffle(items.begin(), items.end(), std::mt19937(n));
+  return items;
+}
+
+static void SmallMapArgs(benchmark::internal::Benchmark* b) {
+  b->ArgName("size");
+  for (int n : {1, 4, 16, 64, 256, 1000, 10000, 100000}) b->Arg(n);
+}
+
+// random keys, at least kLookupNum per iteration so a small map's search path can not be learned by the branch
+// predictor, which would flatter the tree
+template <typename Map>
+static void bench_small_map_find(benchmark::State& state) {
+  constexpr size_t kLookupNum = 4096;
+  using Key = typename Map::key_type;
+  auto items = MakeMapItems<Key>(state.range(0));
+  Map m(items.begin(), items.end());
+  std::vector<Key> keys;
+  std::mt19937 rng(1);
+  for (size_t i = 0; i < std::max(kLookupNum, items.size()); ++i) keys.push_back(items[rng() % items.size()].first);
+
+  for (auto _ : state) {
+    for (const auto& key : keys) benchmark::DoNotOptimize(m.find(key));
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+BENCHMARK_TEMPLATE(bench_small_map_find, std::map<int64_t, int>)->Apply(SmallMapArgs);
+BENCHMARK_TEMPLATE(bench_small_map_find, std::unordered_map<int64_t, int>)->Apply(SmallMapArgs);
+BENCHMARK_TEMPLATE(bench_small_map_find, FlatMap<int64_t, int>)->Apply(SmallMapArgs);
+BENCHMARK_TEMPLATE(bench_small_map_find, EytzingerFlatMap<int64_t, int>)->Apply(SmallMapArgs);
+BENCHMARK_TEMPLATE(bench_small_map_find, std::map<std::string, int>)->Apply(SmallMapArgs);
+BENCHMARK_TEMPLATE(bench_small_map_find, std::unordered_map<std::string, int>)->Apply(SmallMapArgs);
+BENCHMARK_TEMPLATE(bench_small_map_find, FlatMap<std::string, int>)->Apply(SmallMapArgs);
+BENCHMARK_TEMPLATE(bench_small_map_find, EytzingerFlatMap<std::string, int>)->Apply(SmallMapArgs);
+
+// construction from the unsorted items, bulk sort for the flat maps
+template <typename Map>
+static void bench_small_map_build(benchmark::State& state) {
+  auto items = MakeMapItems<typename Map::key_type>(state.range(0));
+  for (auto _ : state) {
+    Map m(items.begin(), items.end());
+    benchmark::DoNotOptimize(m);
+  }
+  state.SetItemsProcessed(state.iterations() * items.size());
+}
+
+BENCHMARK_TEMPLATE(bench_small_map_build, std::map<int64_t, int>)->Apply(SmallMapArgs);
+BENCHMARK_TEMPLATE(bench_small_map_build, std::unordered_map<int64_t, int>)->Apply(SmallMapArgs);
+BENCHMARK_TEMPLATE(bench_small_map_build, FlatMap<int64_t, int>)->Apply(SmallMapArgs);
+BENCHMARK_TEMPLATE(bench_small_map_build, EytzingerFlatMap<int64_t, int>)->Apply(SmallMapArgs);
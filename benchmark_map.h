@@ -1,7 +1,17 @@
 #include <benchmark/benchmark.h>
+#include <algorithm>
 #include <iostream>
 #include <map>
+#include <optional>
+#include <random>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
+#include <vector>
+
+#include "concurrent_hash_map.h"
+#include "flat_hash_map.h"
+#include "rwlock.h"
 
 static void bench_map_insert(benchmark::State& state) {
   for (auto _ : state) {
@@ -27,6 +37,18 @@ static void bench_unordered_map_insert(benchmark::State& state) {
 
 BENCHMARK(bench_unordered_map_insert)->RangeMultiplier(10)->Range(1, 100000);
 
+static void bench_flat_hash_map_insert(benchmark::State& state) {
+  for (auto _ : state) {
+    FlatHashMap<std::string, int> s;
+    int test_t = state.range(0);
+    while (test_t--) {
+      s.insert({std::to_string(test_t), test_t});
+    }
+  }
+}
+
+BENCHMARK(bench_flat_hash_map_insert)->RangeMultiplier(10)->Range(1, 100000);
+
 
 static void bench_map_access(benchmark::State& state) {
   std::map<std::string, int> s;
@@ -62,6 +84,23 @@ static void bench_unordered_map_access(benchmark::State& state) {
 
 BENCHMARK(bench_unordered_map_access)->RangeMultiplier(10)->Range(1, 100000);
 
+static void bench_flat_hash_map_access(benchmark::State& state) {
+  FlatHashMap<std::string, int> s;
+  int test_t = state.range(0);
+  while (test_t--) {
+    s.insert({std::to_string(test_t), test_t});
+  }
+
+  for (auto _ : state) {
+    test_t = state.range(0);
+    while (test_t--) {
+      (void)s[std::to_string(test_t)];
+    }
+  }
+}
+
+BENCHMARK(bench_flat_hash_map_access)->RangeMultiplier(10)->Range(1, 100000);
+
 
 static void bench_map_count(benchmark::State& state) {
   std::map<std::string, int> s;
@@ -96,3 +135,139 @@ static void bench_unordered_map_count(benchmark::State& state) {
 }
 
 BENCHMARK(bench_unordered_map_count)->RangeMultiplier(10)->Range(1, 100000);
+
+static void bench_flat_hash_map_count(benchmark::State& state) {
+  FlatHashMap<std::string, int> s;
+  int test_t = state.range(0);
+  while (test_t--) {
+    s.insert({std::to_string(test_t), test_t});
+  }
+
+  for (auto _ : state) {
+    test_t = state.range(0);
+    while (test_t--) {
+      s.count(std::to_string(test_t));
+    }
+  }
+}
+
+BENCHMARK(bench_flat_hash_map_count)->RangeMultiplier(10)->Range(1, 100000);
+
+// lookups with prebuilt keys, measures the tables alone without std::to_string
+// keys are shuffled, so nodes allocated in insertion order do not get a free ride from the prefetcher
+static std::vector<std::string> MakeKeys(int n) {
+  std::vector<std::string> keys;
+  keys.reserve(n);
+  for (int i = 0; i < n; ++i) keys.push_back("route/" + std::to_string(i));
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(n));
+  return keys;
+}
+
+static void bench_unordered_map_find_prebuilt(benchmark::State& state) {
+  auto keys = MakeKeys(state.range(0));
+  std::unordered_map<std::string, int> s;
+  for (size_t i = 0; i < keys.size(); ++i) s.insert({keys[i], static_cast<int>(i)});
+
+  for (auto _ : state) {
+    for (const auto& key : keys) benchmark::DoNotOptimize(s.find(key));
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+BENCHMARK(bench_unordered_map_find_prebuilt)->RangeMultiplier(10)->Range(1, 100000);
+
+static void bench_flat_hash_map_find_prebuilt(benchmark::State& state) {
+  auto keys = MakeKeys(state.range(0));
+  FlatHashMap<std::string, int> s;
+  for (size_t i = 0; i < keys.size(); ++i) s.insert({keys[i], static_cast<int>(i)});
+
+  for (auto _ : state) {
+    for (const auto& key : keys) benchmark::DoNotOptimize(s.find(key));
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+BENCHMARK(bench_flat_hash_map_find_prebuilt)->RangeMultiplier(10)->Range(1, 100000);
+
+// heterogeneous lookup, no std::string is built for the key
+static void bench_flat_hash_map_find_string_view(benchmark::State& state) {
+  auto keys = MakeKeys(state.range(0));
+  std::vector<std::string_view> views(keys.begin(), keys.end());
+  FlatHashMap<std::string, int> s;
+  for (size_t i = 0; i < keys.size(); ++i) s.insert({keys[i], static_cast<int>(i)});
+
+  for (auto _ : state) {
+    for (auto key : views) benchmark::DoNotOptimize(s.find(key));
+  }
+  state.SetItemsProcessed(state.iterations() * views.size());
+}
+
+BENCHMARK(bench_flat_hash_map_find_string_view)->RangeMultiplier(10)->Range(1, 100000);
+
+// the usual way to share a table between threads, one RwLock around std::unordered_map
+template <typename Key, typename Value>
+class RwLockedMap {
+ public:
+  std::optional<Value> find(const Key& key) const {
+    RwLockReadGuard<> lk(lock_);
+    auto it = map_.find(key);
+    if (it == map_.end()) return std::nullopt;
+    return it->second;
+  }
+
+  bool insert_or_assign(const Key& key, const Value& value) {
+    RwLockWriteGuard<> lk(lock_);
+    return map_.insert_or_assign(key, value).second;
+  }
+
+ private:
+  mutable RwLock lock_;
+  std::unordered_map<Key, Value> map_;
+};
+
+// threads hit kConcurrentMapKeys preloaded keys at random, range(0) percent of operations are writes
+constexpr int64_t kConcurrentMapKeys = 100000;
+
+template <typename Map>
+static void bench_concurrent_map_mixed(benchmark::State& state) {
+  static Map* map = nullptr;
+  if (state.thread_index() == 0) {
+    map = new Map;
+    for (int64_t key = 0; key < kConcurrentMapKeys; ++key) map->insert_or_assign(key, key);
+  }
+
+  const uint32_t write_percent = static_cast<uint32_t>(state.range(0));
+  uint32_t rng = 2463534242u + 977u * static_cast<uint32_t>(state.thread_index());
+  for (auto _ : state) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    const int64_t key = rng % kConcurrentMapKeys;
+    if ((rng >> 20) % 100 < write_percent) {
+      map->insert_or_assign(key, key + 1);
+    } else {
+      benchmark::DoNotOptimize(map->find(key));
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+
+  // all threads have left the loop when thread 0 gets here
+  if (state.thread_index() == 0) {
+    delete map;
+    map = nullptr;
+  }
+}
+
+static void ConcurrentMapArgs(benchmark::internal::Benchmark* b) {
+  b->ArgName("write%");
+  b->Arg(0)->Arg(10)->Arg(50);
+  b->ThreadRange(1, 2 * std::max(1, static_cast<int>(std::thread::hardware_concurrency())));
+  b->UseRealTime();
+}
+
+BENCHMARK_TEMPLATE(bench_concurrent_map_mixed, RwLockedMap<int64_t, int64_t>)->Apply(ConcurrentMapArgs);
+// shards locked for reads too, what non trivially copyable types get
+BENCHMARK_TEMPLATE(bench_concurrent_map_mixed,
+                   ConcurrentHashMap<int64_t, int64_t, FlatHash<int64_t>, std::equal_to<int64_t>, false>)
+    ->Apply(ConcurrentMapArgs);
+BENCHMARK_TEMPLATE(bench_concurrent_map_mixed, ConcurrentHashMap<int64_t, int64_t>)->Apply(ConcurrentMapArgs);
@@ -0,0 +1,75 @@
+#include <benchmark/benchmark.h>
+
+#include <iterator>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "perfect_hash.h"
+
+// URL schemes, a static key set of the kind IsNetFile looks up
+constexpr std::string_view kSchemes[] = {"http", "https", "ftp",  "ftps", "sftp", "file", "rtsp", "rtmp",
+                                         "rtp",  "udp",   "tcp",  "ws",   "wss",  "s3",   "hdfs", "data"};
+
+// three hits for every miss, in a fixed random order
+static std::vector<std::string> MakeSchemeQueries() {
+  std::vector<std::string> queries;
+  std::mt19937 rng(1);
+  for (int i = 0; i < 1024; ++i) {
+    if (i % 4 == 3) {
+      queries.push_back("scheme" + std::to_string(rng() % 100));
+    } else {
+      queries.emplace_back(kSchemes[rng() % std::size(kSchemes)]);
+    }
+  }
+  return queries;
+}
+
+static void bench_scheme_perfect_hash(benchmark::State& state) {
+  static constexpr auto kTable = MakePerfectHashMap<int>({{"http", 0}, {"https", 1}, {"ftp", 2},   {"ftps", 3},
+                                                          {"sftp", 4}, {"file", 5},  {"rtsp", 6},  {"rtmp", 7},
+                                                          {"rtp", 8},  {"udp", 9},   {"tcp", 10},  {"ws", 11},
+                                                          {"wss", 12}, {"s3", 13},   {"hdfs", 14}, {"data", 15}});
+  auto queries = MakeSchemeQueries();
+  for (auto _ : state) {
+    for (const auto& q : queries) benchmark::DoNotOptimize(kTable.find(q));
+  }
+  state.SetItemsProcessed(state.iterations() * queries.size());
+}
+
+BENCHMARK(bench_scheme_perfect_hash);
+
+static void bench_scheme_unordered_map(benchmark::State& state) {
+  std::unordered_map<std::string_view, int> table;
+  for (size_t i = 0; i < std::size(kSchemes); ++i) table.emplace(kSchemes[i], static_cast<int>(i));
+  auto queries = MakeSchemeQueries();
+  for (auto _ : state) {
+    for (const auto& q : queries) benchmark::DoNotOptimize(table.find(q));
+  }
+  state.SetItemsProcessed(state.iterations() * queries.size());
+}
+
+BENCHMARK(bench_scheme_unordered_map);
+
+// what IsNetFile used to do, compare against every key in turn
+static void bench_scheme_linear_scan(benchmark::State& state) {
+  std::vector<std::string> table(std::begin(kSchemes), std::end(kSchemes));
+  auto queries = MakeSchemeQueries();
+  for (auto _ : state) {
+    for (const auto& q : queries) {
+      int found = -1;
+      for (size_t i = 0; i < table.size(); ++i) {
+        if (table[i] == q) {
+          found = static_cast<int>(i);
+          break;
+        }
+      }
+      benchmark::DoNotOptimize(found);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * queries.size());
+}
+
+BENCHMARK(bench_scheme_linear_scan);
@@ -0,0 +1,181 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "string_intern.h"
+
+// calls of global operator new by this thread, replaced in string_intern_benchmark.cpp
+extern thread_local int64_t g_allocation_count;
+
+// allocations made by the benchmark thread during the timed loop, reported per iteration. Counters of several
+// benchmark threads are summed by the library
+class AllocationCounter {
+ public:
+  explicit AllocationCounter(benchmark::State& state) : state_(state), start_(g_allocation_count) {}
+  ~AllocationCounter() {
+    state_.counters["allocs"] = benchmark::Counter(static_cast<double>(g_allocation_count - start_),
+                                                   benchmark::Counter::kAvgIterations);
+  }
+
+ private:
+  benchmark::State& state_;
+  int64_t start_;
+};
+
+// request-path like keys, long enough to not fit std::string's inline buffer, in a single text buffer
+// so the views look like tokens of a parsed request
+struct PathKeys {
+  explicit PathKeys(int n) {
+    std::vector<size_t> offsets;
+    for (int i = 0; i < n; ++i) {
+      offsets.push_back(text.size());
+      text += "/api/v1/resource/" + std::to_string(i);
+    }
+    offsets.push_back(text.size());
+    for (int i = 0; i < n; ++i) views.emplace_back(text.data() + offsets[i], offsets[i + 1] - offsets[i]);
+    std::shuffle(views.begin(), views.end(), std::mt19937(n));
+  }
+
+  std::string text;
+  std::vector<std::string_view> views;
+};
+
+static void bench_unordered_map_build_strings(benchmark::State& state) {
+  PathKeys keys(state.range(0));
+  AllocationCounter allocs(state);
+  for (auto _ : state) {
+    std::unordered_map<std::string, int> s;
+    for (auto key : keys.views) s.emplace(std::string(key), 0);
+    benchmark::DoNotOptimize(s);
+  }
+  state.SetItemsProcessed(state.iterations() * keys.views.size());
+}
+
+BENCHMARK(bench_unordered_map_build_strings)->RangeMultiplier(10)->Range(1, 100000);
+
+static void bench_string_map_build(benchmark::State& state) {
+  PathKeys keys(state.range(0));
+  AllocationCounter allocs(state);
+  for (auto _ : state) {
+    StringMap<int> s;
+    for (auto key : keys.views) s.emplace(key, 0);
+    benchmark::DoNotOptimize(s);
+  }
+  state.SetItemsProcessed(state.iterations() * keys.views.size());
+}
+
+BENCHMARK(bench_string_map_build)->RangeMultiplier(10)->Range(1, 100000);
+
+static void bench_interned_map_build(benchmark::State& state) {
+  PathKeys keys(state.range(0));
+  AllocationCounter allocs(state);
+  for (auto _ : state) {
+    StringPool pool;
+    InternedMap<int> s;
+    for (auto key : keys.views) s.try_emplace(pool.Intern(key), 0);
+    benchmark::DoNotOptimize(s);
+  }
+  state.SetItemsProcessed(state.iterations() * keys.views.size());
+}
+
+BENCHMARK(bench_interned_map_build)->RangeMultiplier(10)->Range(1, 100000);
+
+// lookups start from a string_view into the request, the current way builds a std::string for it
+static void bench_unordered_map_lookup_view(benchmark::State& state) {
+  PathKeys keys(state.range(0));
+  std::unordered_map<std::string, int> s;
+  for (auto key : keys.views) s.emplace(std::string(key), 0);
+
+  AllocationCounter allocs(state);
+  for (auto _ : state) {
+    for (auto key : keys.views) benchmark::DoNotOptimize(s.find(std::string(key)));
+  }
+  state.SetItemsProcessed(state.iterations() * keys.views.size());
+}
+
+BENCHMARK(bench_unordered_map_lookup_view)->RangeMultiplier(10)->Range(1, 100000);
+
+static void bench_map_lookup_view(benchmark::State& state) {
+  PathKeys keys(state.range(0));
+  std::map<std::string, int> s;
+  for (auto key : keys.views) s.emplace(std::string(key), 0);
+
+  AllocationCounter allocs(state);
+  for (auto _ : state) {
+    for (auto key : keys.views) benchmark::DoNotOptimize(s.find(std::string(key)));
+  }
+  state.SetItemsProcessed(state.iterations() * keys.views.size());
+}
+
+BENCHMARK(bench_map_lookup_view)->RangeMultiplier(10)->Range(1, 100000);
+
+static void bench_string_map_lookup_view(benchmark::State& state) {
+  PathKeys keys(state.range(0));
+  StringMap<int> s;
+  for (auto key : keys.views) s.emplace(key, 0);
+
+  AllocationCounter allocs(state);
+  for (auto _ : state) {
+    for (auto key : keys.views) benchmark::DoNotOptimize(s.find(key));
+  }
+  state.SetItemsProcessed(state.iterations() * keys.views.size());
+}
+
+BENCHMARK(bench_string_map_lookup_view)->RangeMultiplier(10)->Range(1, 100000);
+
+static void bench_string_hash_map_lookup_view(benchmark::State& state) {
+  PathKeys keys(state.range(0));
+  StringHashMap<int> s;
+  for (auto key : keys.views) s.try_emplace(std::string(key), 0);
+
+  AllocationCounter allocs(state);
+  for (auto _ : state) {
+    for (auto key : keys.views) benchmark::DoNotOptimize(s.find(key));
+  }
+  state.SetItemsProcessed(state.iterations() * keys.views.size());
+}
+
+BENCHMARK(bench_string_hash_map_lookup_view)->RangeMultiplier(10)->Range(1, 100000);
+
+// string_view to handle through the pool, then handle to value
+static void bench_interned_map_lookup_view(benchmark::State& state) {
+  PathKeys keys(state.range(0));
+  StringPool pool;
+  InternedMap<int> s;
+  for (auto key : keys.views) s.try_emplace(pool.Intern(key), 0);
+
+  AllocationCounter allocs(state);
+  for (auto _ : state) {
+    for (auto key : keys.views) benchmark::DoNotOptimize(s.find(pool.Find(key)));
+  }
+  state.SetItemsProcessed(state.iterations() * keys.views.size());
+}
+
+BENCHMARK(bench_interned_map_lookup_view)->RangeMultiplier(10)->Range(1, 100000);
+
+// handles interned once up front, the steady state of a caller that keeps them
+static void bench_interned_map_lookup_handle(benchmark::State& state) {
+  PathKeys keys(state.range(0));
+  StringPool pool;
+  InternedMap<int> s;
+  std::vector<InternedString> handles;
+  for (auto key : keys.views) {
+    handles.push_back(pool.Intern(key));
+    s.try_emplace(handles.back(), 0);
+  }
+
+  AllocationCounter allocs(state);
+  for (auto _ : state) {
+    for (auto handle : handles) benchmark::DoNotOptimize(s.find(handle));
+  }
+  state.SetItemsProcessed(state.iterations() * handles.size());
+}
+
+BENCHMARK(bench_interned_map_lookup_handle)->RangeMultiplier(10)->Range(1, 100000);
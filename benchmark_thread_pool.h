@@ -0,0 +1,171 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "thread_pool.h"
+#include "threadsafe_queue.h"
+
+// busy work of `n` iterations, stands for the task body
+inline void TaskWork(int64_t n) {
+  int64_t acc = 0;
+  for (int64_t i = 0; i < n; ++i) benchmark::DoNotOptimize(acc += i);
+}
+
+inline void WaitCount(const std::atomic<int64_t>& count, int64_t target) {
+  while (count.load(std::memory_order_acquire) < target) std::this_thread::yield();
+}
+
+inline int MaxPoolThreads() { return std::max(1, static_cast<int>(std::thread::hardware_concurrency())); }
+
+static void PoolThreadArgs(benchmark::internal::Benchmark* b) {
+  b->ArgName("threads");
+  b->RangeMultiplier(2)->Range(1, MaxPoolThreads());
+  b->UseRealTime();
+}
+
+// time spent in Push by the submitting thread, tasks are empty
+template <typename Pool>
+static void bench_pool_push(benchmark::State& state) {
+  Pool pool(nullptr, state.range(0));
+  std::atomic<int64_t> done{0};
+  int64_t pushed = 0;
+  for (auto _ : state) {
+    auto f = pool.Push(0, [&done]() { done.fetch_add(1, std::memory_order_release); });
+    benchmark::DoNotOptimize(f);
+    ++pushed;
+  }
+  // timing stops with the loop, tasks left in the queue do not count
+  WaitCount(done, pushed);
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_TEMPLATE(bench_pool_push, EqualityThreadPool)->Apply(PoolThreadArgs);
+BENCHMARK_TEMPLATE(bench_pool_push, PriorityThreadPool)->Apply(PoolThreadArgs);
+
+// same as bench_pool_push without the packaged_task and future
+template <typename Pool>
+static void bench_pool_void_push(benchmark::State& state) {
+  Pool pool(nullptr, state.range(0));
+  std::atomic<int64_t> done{0};
+  int64_t pushed = 0;
+  for (auto _ : state) {
+    pool.VoidPush(0, [&done]() { done.fetch_add(1, std::memory_order_release); });
+    ++pushed;
+  }
+  // timing stops with the loop, tasks left in the queue do not count
+  WaitCount(done, pushed);
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_TEMPLATE(bench_pool_void_push, EqualityThreadPool)->Apply(PoolThreadArgs);
+BENCHMARK_TEMPLATE(bench_pool_void_push, PriorityThreadPool)->Apply(PoolThreadArgs);
+
+// one task in flight, from Push until the result is back in the submitting thread
+template <typename Pool>
+static void bench_pool_round_trip(benchmark::State& state) {
+  Pool pool(nullptr, state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(pool.Push(0, []() { return 1; }).get());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_TEMPLATE(bench_pool_round_trip, EqualityThreadPool)->Apply(PoolThreadArgs);
+BENCHMARK_TEMPLATE(bench_pool_round_trip, PriorityThreadPool)->Apply(PoolThreadArgs);
+
+// end-to-end time of a VoidPush task, completion is signalled with an atomic instead of a future
+template <typename Pool>
+static void bench_pool_void_round_trip(benchmark::State& state) {
+  Pool pool(nullptr, state.range(0));
+  std::atomic<int64_t> done{0};
+  int64_t pushed = 0;
+  for (auto _ : state) {
+    pool.VoidPush(0, [&done]() { done.fetch_add(1, std::memory_order_release); });
+    WaitCount(done, ++pushed);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_TEMPLATE(bench_pool_void_round_trip, EqualityThreadPool)->Apply(PoolThreadArgs);
+BENCHMARK_TEMPLATE(bench_pool_void_round_trip, PriorityThreadPool)->Apply(PoolThreadArgs);
+
+// batches of tasks of range(0) work iterations on range(1) pool threads, priorities are random for priority pool
+template <typename Pool>
+static void bench_pool_throughput(benchmark::State& state) {
+  constexpr int64_t kBatch = 1000;
+  const int64_t task_size = state.range(0);
+  Pool pool(nullptr, state.range(1));
+  std::atomic<int64_t> done{0};
+  int64_t pushed = 0;
+  uint32_t rng = 2463534242u;
+  for (auto _ : state) {
+    for (int64_t i = 0; i < kBatch; ++i) {
+      rng ^= rng << 13;
+      rng ^= rng >> 17;
+      rng ^= rng << 5;
+      pool.VoidPush(rng % 16, [&done, task_size]() {
+        TaskWork(task_size);
+        done.fetch_add(1, std::memory_order_release);
+      });
+    }
+    pushed += kBatch;
+    WaitCount(done, pushed);
+  }
+  state.SetItemsProcessed(state.iterations() * kBatch);
+}
+
+static void PoolThroughputArgs(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"task_size", "threads"});
+  std::vector<int64_t> threads;
+  for (int n = 1; n <= MaxPoolThreads(); n *= 2) threads.push_back(n);
+  b->ArgsProduct({{0, 100, 1000, 10000}, threads});
+  b->UseRealTime();
+}
+
+BENCHMARK_TEMPLATE(bench_pool_throughput, EqualityThreadPool)->Apply(PoolThroughputArgs);
+BENCHMARK_TEMPLATE(bench_pool_throughput, PriorityThreadPool)->Apply(PoolThroughputArgs);
+
+// range(0) producers push kItems in total, range(1) consumers pop them
+template <typename Queue>
+static void bench_queue_producer_consumer(benchmark::State& state) {
+  constexpr int64_t kItems = 100000;
+  const int producer_num = static_cast<int>(state.range(0));
+  const int consumer_num = static_cast<int>(state.range(1));
+  for (auto _ : state) {
+    Queue q;
+    std::atomic<int64_t> consumed{0};
+    std::vector<std::thread> ths;
+    for (int i = 0; i < producer_num; ++i) {
+      ths.emplace_back([&q, producer_num, i]() {
+        for (int64_t n = i; n < kItems; n += producer_num) q.Push(n);
+      });
+    }
+    for (int i = 0; i < consumer_num; ++i) {
+      ths.emplace_back([&q, &consumed]() {
+        int64_t value;
+        while (consumed.load(std::memory_order_relaxed) < kItems) {
+          if (q.WaitAndTryPop(value, std::chrono::microseconds(100))) {
+            consumed.fetch_add(1, std::memory_order_relaxed);
+          }
+        }
+      });
+    }
+    for (auto& th : ths) th.join();
+  }
+  state.SetItemsProcessed(state.iterations() * kItems);
+}
+
+static void ProducerConsumerArgs(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"producers", "consumers"});
+  b->ArgsProduct({{1, 2, 4, 8}, {1, 2, 4, 8}});
+  b->UseRealTime();
+}
+
+BENCHMARK_TEMPLATE(bench_queue_producer_consumer, TSQueue<int64_t>)->Apply(ProducerConsumerArgs);
+BENCHMARK_TEMPLATE(bench_queue_producer_consumer, TSPriorityQueue<int64_t>)->Apply(ProducerConsumerArgs);
@@ -0,0 +1,219 @@
+/**
+ * @file big_reader_mutex.h
+ *
+ * This file contains a declaration of BigReaderRwMutex, a read-mostly reader-writer mutex.
+ */
+
+#ifndef CXXUTIL_BIG_READER_MUTEX_H_
+#define CXXUTIL_BIG_READER_MUTEX_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include "futex.h"
+#include "rw_mutex.h"
+#include "spinlock.h"
+
+/**
+ * @brief Big-reader lock, readers only touch a cache line of their own, writers scan all of them
+ *
+ * Every thread is mapped to one of kSlotNum cache-line-padded reader counters. Read lock increments the counter
+ * of the calling thread and checks the writer flag, so readers never write shared memory while no writer is around.
+ * Write lock is expensive: it raises the writer flag and waits until the sum of all counters drains to zero.
+ * Writers take precedence, a reader arriving while a writer holds or waits backs off until it finishes.
+ * Upgrade mode only takes the writer mutex, so it runs alongside readers and raises the flag on Upgrade().
+ *
+ * Works with ReadLockGuard, WriteLockGuard and BasicUniqueReadLock / BasicUniqueWriteLock / BasicUniqueRwLock.
+ */
+class BigReaderRwMutex {
+ public:
+  static constexpr size_t kSlotNum = 64;
+
+  BigReaderRwMutex() noexcept = default;
+  ~BigReaderRwMutex() = default;
+
+  void ReadLock() {
+    Slot& slot = slots_[SlotIndex()];
+    for (;;) {
+      // seq_cst pairs with writer: either the writer sees our count, or we see its flag
+      slot.readers.fetch_add(1, std::memory_order_seq_cst);
+      if (writer_.load(std::memory_order_seq_cst) == 0) return;
+      slot.readers.fetch_sub(1, std::memory_order_release);
+      WaitWriter();
+    }
+  }
+
+  void ReadUnlock() {
+    // sum over slots is what matters, unlocking on another thread is fine
+    slots_[SlotIndex()].readers.fetch_sub(1, std::memory_order_release);
+  }
+
+  void WriteLock() {
+    writer_mutex_.lock();
+    writer_.store(1, std::memory_order_seq_cst);
+    WaitReaders();
+  }
+
+  void WriteUnlock() {
+    writer_.store(0, std::memory_order_seq_cst);
+    if (waiting_readers_.load(std::memory_order_seq_cst) > 0) FutexWake(&writer_, INT32_MAX);
+    writer_mutex_.unlock();
+  }
+
+  void UpgradeLock() {
+    writer_mutex_.lock();
+    upgrade_.store(true, std::memory_order_relaxed);
+  }
+
+  void UpgradeUnlock() {
+    upgrade_.store(false, std::memory_order_relaxed);
+    writer_mutex_.unlock();
+  }
+
+  // upgrade holder -> writer, writer mutex is already held
+  void Upgrade() {
+    upgrade_.store(false, std::memory_order_relaxed);
+    writer_.store(1, std::memory_order_seq_cst);
+    WaitReaders();
+  }
+
+  // writer -> reader, count ourselves in before dropping the flag
+  void Downgrade() {
+    slots_[SlotIndex()].readers.fetch_add(1, std::memory_order_seq_cst);
+    WriteUnlock();
+  }
+
+  bool Reading() { return ReaderCount() > 0; }
+  bool Writing() { return writer_.load(std::memory_order_acquire) != 0; }
+  bool Upgrading() { return upgrade_.load(std::memory_order_relaxed); }
+
+  template <typename Mutex>
+  friend class BasicUniqueReadLock;
+  template <typename Mutex>
+  friend class BasicUniqueWriteLock;
+  template <typename Mutex>
+  friend class BasicUniqueRwLock;
+  template <typename LockType>
+  friend class ProfiledLock;
+
+ private:
+  static constexpr uint32_t kSpinCount = 1024;
+
+  struct alignas(kCacheLineSize) Slot {
+    std::atomic<int64_t> readers{0};
+  };
+
+  static size_t SlotIndex() {
+    static std::atomic<size_t> next_index{0};
+    static thread_local size_t index = next_index.fetch_add(1, std::memory_order_relaxed) % kSlotNum;
+    return index;
+  }
+
+  int64_t ReaderCount() const {
+    int64_t sum = 0;
+    for (auto& slot : slots_) sum += slot.readers.load(std::memory_order_acquire);
+    return sum;
+  }
+
+  void WaitReaders() {
+    uint32_t spin_count = 0;
+    while (ReaderCount() != 0) {
+      if (++spin_count < kSpinCount) {
+        CpuRelax();
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  void WaitWriter() {
+    uint32_t spin_count = 0;
+    while (writer_.load(std::memory_order_acquire) != 0) {
+      if (++spin_count < kSpinCount) {
+        CpuRelax();
+        continue;
+      }
+      waiting_readers_.fetch_add(1, std::memory_order_seq_cst);
+      if (writer_.load(std::memory_order_seq_cst) != 0) FutexWait(&writer_, uint32_t(1));
+      waiting_readers_.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+
+  // counting interface used by unique locks, see RwMutex
+  void ReadLock(size_t *count, size_t *reading) {
+    ReadLock();
+    if (count) ++*count;
+    if (reading) ++*reading;
+  }
+
+  void ReadUnlock(size_t *count, size_t *reading, bool release = false) {
+    size_t n = 1;
+    if (count) {
+      if (*count == 0) return;
+      n = release ? *count : 1;
+      *count -= n;
+    }
+    if (reading) *reading = *reading > n ? *reading - n : 0;
+    slots_[SlotIndex()].readers.fetch_sub(static_cast<int64_t>(n), std::memory_order_release);
+  }
+
+  void WriteLock(size_t *count) {
+    WriteLock();
+    if (count) ++*count;
+  }
+
+  void WriteUnlock(size_t *count, bool /* release */ = false) {
+    if (count) {
+      if (*count == 0) return;
+      // writer lock is not recursive, guard holds it at most once
+      *count = 0;
+    }
+    WriteUnlock();
+  }
+
+  void UpgradeLock(size_t *count) {
+    UpgradeLock();
+    if (count) ++*count;
+  }
+
+  void UpgradeUnlock(size_t *count, bool /* release */ = false) {
+    if (count) {
+      if (*count == 0) return;
+      *count = 0;
+    }
+    UpgradeUnlock();
+  }
+
+  void Upgrade(size_t *upgrade_count, size_t *write_count) {
+    if (upgrade_count) {
+      if (*upgrade_count == 0) return;
+      --*upgrade_count;
+    }
+    Upgrade();
+    if (write_count) ++*write_count;
+  }
+
+  void Downgrade(size_t *write_count, size_t *read_count, size_t *reading) {
+    if (write_count) {
+      if (*write_count == 0) return;
+      --*write_count;
+    }
+    Downgrade();
+    if (read_count) ++*read_count;
+    if (reading) ++*reading;
+  }
+
+  BigReaderRwMutex(const BigReaderRwMutex &) = delete;
+  BigReaderRwMutex &operator=(const BigReaderRwMutex &) = delete;
+
+  Slot slots_[kSlotNum];
+  alignas(kCacheLineSize) std::atomic<uint32_t> writer_{0};
+  std::atomic<uint32_t> waiting_readers_{0};
+  std::atomic<bool> upgrade_{false};
+  std::mutex writer_mutex_;
+};  // BigReaderRwMutex
+
+#endif  // CXXUTIL_BIG_READER_MUTEX_H_
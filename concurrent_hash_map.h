@@ -0,0 +1,398 @@
+/**
+ * @file concurrent_hash_map.h
+ *
+ * This file contains a declaration of ConcurrentHashMap, a hash map split into independently locked shards.
+ */
+
+#ifndef CXXUTIL_CONCURRENT_HASH_MAP_H_
+#define CXXUTIL_CONCURRENT_HASH_MAP_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "flat_hash_map.h"
+#include "rcu.h"
+#include "seqlock.h"
+#include "spinlock.h"
+
+namespace detail {
+
+template <typename Key, typename Value>
+constexpr bool kCanReadOptimistically = std::is_trivially_copyable<Key>::value &&
+                                        std::is_trivially_copyable<Value>::value &&
+                                        std::is_default_constructible<Key>::value &&
+                                        std::is_default_constructible<Value>::value;
+
+/**
+ * @brief Shard for trivially copyable keys and values, readers take no lock
+ *
+ * Linear-probing table, every slot is a small seqlock over its state, key and value.
+ * Writers are serialized by a SpinLock. A rebuilt table is published with a single pointer store, readers probe
+ * inside a RcuDomain read section and the old table is freed after a grace period, outside the shard lock.
+ */
+template <typename Key, typename Value, typename Hash, typename Eq>
+class OptimisticShard {
+ public:
+  OptimisticShard() : table_(new Table(kMinCapacity)) {}
+  ~OptimisticShard() { delete table_.load(std::memory_order_relaxed); }
+
+  bool Find(size_t hash, const Key& key, Value* value) const {
+    RcuReadGuard guard;
+    const Table* table = table_.load(std::memory_order_acquire);
+    for (size_t i = hash & table->mask, n = 0; n <= table->mask; i = (i + 1) & table->mask, ++n) {
+      const Slot& slot = table->slots[i];
+      uint8_t state;
+      bool match;
+      uint32_t spin_count = 0;
+      while (!TryReadSlot(slot, key, &state, &match, value)) {
+        // writer may have been preempted mid-write
+        if (++spin_count < kSpinCount) {
+          CpuRelax();
+        } else {
+          std::this_thread::yield();
+        }
+      }
+      if (state == kEmpty) return false;
+      if (match) return true;
+    }
+    return false;
+  }
+
+  bool InsertOrAssign(size_t hash, const Key& key, const Value& value) {
+    std::unique_ptr<Table> retired;
+    {
+      SpinLockGuard lk(writer_lock_);
+      Table* table = table_.load(std::memory_order_relaxed);
+      size_t idx;
+      if (Locate(table, hash, key, &idx)) {
+        WriteSlot(&table->slots[idx], kFull, key, value);
+        return false;
+      }
+      retired = Insert(hash, key, value);
+    }
+    Reclaim(std::move(retired));
+    return true;
+  }
+
+  template <typename Func>
+  Value ComputeIfAbsent(size_t hash, const Key& key, Func& func) {
+    std::unique_ptr<Table> retired;
+    Value value;
+    {
+      SpinLockGuard lk(writer_lock_);
+      Table* table = table_.load(std::memory_order_relaxed);
+      size_t idx;
+      if (Locate(table, hash, key, &idx)) return table->slots[idx].value.Load();
+      value = func(key);
+      retired = Insert(hash, key, value);
+    }
+    Reclaim(std::move(retired));
+    return value;
+  }
+
+  bool Erase(size_t hash, const Key& key) {
+    SpinLockGuard lk(writer_lock_);
+    Table* table = table_.load(std::memory_order_relaxed);
+    size_t idx;
+    if (!Locate(table, hash, key, &idx)) return false;
+    // no probe sequence continues past an empty successor, the slot can go back to empty
+    Slot& next = table->slots[(idx + 1) & table->mask];
+    if (next.state.load(std::memory_order_relaxed) == kEmpty) {
+      WriteSlot(&table->slots[idx], kEmpty, Key{}, Value{});
+      --table->used;
+    } else {
+      WriteSlot(&table->slots[idx], kDeleted, Key{}, Value{});
+    }
+    size_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  size_t Size() const { return size_.load(std::memory_order_relaxed); }
+
+ private:
+  static constexpr size_t kMinCapacity = 16;
+  static constexpr uint32_t kSpinCount = 128;
+  static constexpr uint8_t kEmpty = 0;
+  static constexpr uint8_t kFull = 1;
+  static constexpr uint8_t kDeleted = 2;
+
+  struct Slot {
+    std::atomic<uint32_t> seq{0};
+    std::atomic<uint8_t> state{kEmpty};
+    AtomicStorage<Key> key;
+    AtomicStorage<Value> value;
+  };
+
+  struct Table {
+    explicit Table(size_t capacity) : mask(capacity - 1), slots(new Slot[capacity]) {}
+    size_t mask;
+    // full and deleted slots, written under the shard lock
+    size_t used = 0;
+    std::unique_ptr<Slot[]> slots;
+  };
+
+  // one optimistic read of a slot, the key is compared inside the read so only a matching value is copied
+  bool TryReadSlot(const Slot& slot, const Key& key, uint8_t* state, bool* match, Value* value) const {
+    uint32_t begin = slot.seq.load(std::memory_order_acquire);
+    if (begin & 1) return false;
+    *state = slot.state.load(std::memory_order_relaxed);
+    // a torn key may compare either way, the sequence check below throws the result away then
+    *match = *state == kFull && eq_(slot.key.Load(), key);
+    Value v;
+    if (*match) v = slot.value.Load();
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.seq.load(std::memory_order_relaxed) != begin) return false;
+    if (*match) *value = v;
+    return true;
+  }
+
+  static void WriteSlot(Slot* slot, uint8_t state, const Key& key, const Value& value) {
+    uint32_t seq = slot->seq.load(std::memory_order_relaxed);
+    slot->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->state.store(state, std::memory_order_relaxed);
+    slot->key.Store(key);
+    slot->value.Store(value);
+    slot->seq.store(seq + 2, std::memory_order_release);
+  }
+
+  // writer side lookup, *idx is the slot holding key
+  bool Locate(const Table* table, size_t hash, const Key& key, size_t* idx) const {
+    for (size_t i = hash & table->mask, n = 0; n <= table->mask; i = (i + 1) & table->mask, ++n) {
+      const Slot& slot = table->slots[i];
+      uint8_t state = slot.state.load(std::memory_order_relaxed);
+      if (state == kEmpty) return false;
+      if (state == kFull && eq_(slot.key.Load(), key)) {
+        *idx = i;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // key known to be absent, returns the replaced table if it had to rebuild
+  std::unique_ptr<Table> Insert(size_t hash, const Key& key, const Value& value) {
+    std::unique_ptr<Table> retired;
+    Table* table = table_.load(std::memory_order_relaxed);
+    if ((table->used + 1) * 4 > (table->mask + 1) * 3) {
+      retired.reset(table);
+      table = Rebuild();
+    }
+    for (size_t i = hash & table->mask;; i = (i + 1) & table->mask) {
+      uint8_t state = table->slots[i].state.load(std::memory_order_relaxed);
+      if (state != kFull) {
+        if (state == kEmpty) ++table->used;
+        WriteSlot(&table->slots[i], kFull, key, value);
+        break;
+      }
+    }
+    size_.fetch_add(1, std::memory_order_relaxed);
+    return retired;
+  }
+
+  // readers may still probe the old table until a grace period has passed
+  static void Reclaim(std::unique_ptr<Table> table) {
+    if (table) RcuDomain::Instance().Synchronize();
+  }
+
+  // copies live entries to a fresh table, doubles only if they need it, tombstones are dropped
+  Table* Rebuild() {
+    Table* old = table_.load(std::memory_order_relaxed);
+    size_t capacity = old->mask + 1;
+    if ((Size() + 1) * 2 > capacity) capacity *= 2;
+    std::unique_ptr<Table> table(new Table(capacity));
+    for (size_t i = 0; i <= old->mask; ++i) {
+      const Slot& slot = old->slots[i];
+      if (slot.state.load(std::memory_order_relaxed) != kFull) continue;
+      Key key = slot.key.Load();
+      size_t j = hash_(key) & table->mask;
+      while (table->slots[j].state.load(std::memory_order_relaxed) != kEmpty) j = (j + 1) & table->mask;
+      // not visible to anyone yet, no sequence needed
+      table->slots[j].state.store(kFull, std::memory_order_relaxed);
+      table->slots[j].key.Store(key);
+      table->slots[j].value.Store(slot.value.Load());
+      ++table->used;
+    }
+    table_.store(table.get(), std::memory_order_release);
+    return table.release();
+  }
+
+  OptimisticShard(const OptimisticShard&) = delete;
+  OptimisticShard& operator=(const OptimisticShard&) = delete;
+
+  std::atomic<Table*> table_;
+  std::atomic<size_t> size_{0};
+  SpinLock writer_lock_;
+  Hash hash_;
+  Eq eq_;
+};  // OptimisticShard
+
+/**
+ * @brief Shard for any key and value, a FlatHashMap under a SpinLock, readers lock too
+ */
+template <typename Key, typename Value, typename Hash, typename Eq>
+class LockedShard {
+ public:
+  LockedShard() = default;
+
+  // optional, so Value need not be default constructible
+  bool Find(size_t, const Key& key, std::optional<Value>* value) const {
+    SpinLockGuard lk(lock_);
+    auto it = map_.find(key);
+    if (it == map_.end()) return false;
+    value->emplace(it->second);
+    return true;
+  }
+
+  bool InsertOrAssign(size_t, const Key& key, const Value& value) {
+    SpinLockGuard lk(lock_);
+    return map_.insert_or_assign(key, value).second;
+  }
+
+  template <typename Func>
+  Value ComputeIfAbsent(size_t, const Key& key, Func& func) {
+    SpinLockGuard lk(lock_);
+    auto it = map_.find(key);
+    if (it == map_.end()) it = map_.try_emplace(key, func(key)).first;
+    return it->second;
+  }
+
+  bool Erase(size_t, const Key& key) {
+    SpinLockGuard lk(lock_);
+    return map_.erase(key) != 0;
+  }
+
+  size_t Size() const {
+    SpinLockGuard lk(lock_);
+    return map_.size();
+  }
+
+ private:
+  LockedShard(const LockedShard&) = delete;
+  LockedShard& operator=(const LockedShard&) = delete;
+
+  mutable SpinLock lock_;
+  FlatHashMap<Key, Value, Hash, Eq> map_;
+};  // LockedShard
+
+}  // namespace detail
+
+/**
+ * @brief Hash map for many threads, keys are spread over shards that lock independently
+ *
+ * Values are returned by copy, a reference could be invalidated by another thread at any time.
+ * With trivially copyable Key and Value find() takes no lock at all (see detail::OptimisticShard),
+ * otherwise each shard is a FlatHashMap guarded by a SpinLock. Writers to one shard are serialized,
+ * pick enough shards for the number of writing threads. In the lock-free mode a write that rebuilds a table waits
+ * for a RcuDomain grace period, so writes must not be made from inside a read section.
+ */
+template <typename Key, typename Value, typename Hash = FlatHash<Key>, typename Eq = std::equal_to<Key>,
+          bool OptimisticReads = detail::kCanReadOptimistically<Key, Value>>
+class ConcurrentHashMap {
+  static_assert(!OptimisticReads || detail::kCanReadOptimistically<Key, Value>,
+                "Optimistic reads require trivially copyable, default constructible key and value");
+
+ public:
+  using key_type = Key;
+  using mapped_type = Value;
+
+  /**
+   * @param shard_num rounded up to a power of 2, at most 65536
+   */
+  explicit ConcurrentHashMap(size_t shard_num = 16) {
+    size_t n = 1;
+    while (n < shard_num && n < kMaxShardNum) n *= 2;
+    shard_mask_ = n - 1;
+    shards_.reset(new PaddedShard[n]);
+  }
+
+  std::optional<Value> find(const Key& key) const {
+    size_t hash = hash_(key);
+    if constexpr (OptimisticReads) {
+      // copied out of the slot seqlock, which needs a Value to copy into
+      Value value;
+      if (!ShardOf(hash).Find(hash, key, &value)) return std::nullopt;
+      return value;
+    } else {
+      std::optional<Value> value;
+      ShardOf(hash).Find(hash, key, &value);
+      return value;
+    }
+  }
+
+  bool contains(const Key& key) const { return find(key).has_value(); }
+
+  /**
+   * @return true if key was inserted, false if an existing value was replaced
+   */
+  bool insert_or_assign(const Key& key, const Value& value) {
+    size_t hash = hash_(key);
+    return ShardOf(hash).InsertOrAssign(hash, key, value);
+  }
+
+  /**
+   * @return number of erased elements, 0 or 1
+   */
+  size_t erase(const Key& key) {
+    size_t hash = hash_(key);
+    return ShardOf(hash).Erase(hash, key) ? 1 : 0;
+  }
+
+  /**
+   * @brief Value of key, inserting func(key) if absent
+   *
+   * func runs under the shard lock, at most once per missing key, and must not touch this map.
+   */
+  template <typename Func>
+  Value compute_if_absent(const Key& key, Func&& func) {
+    size_t hash = hash_(key);
+    if constexpr (OptimisticReads) {
+      // the common hit path stays lock-free
+      Value value;
+      if (ShardOf(hash).Find(hash, key, &value)) return value;
+    }
+    return ShardOf(hash).ComputeIfAbsent(hash, key, func);
+  }
+
+  /// sum over shards, not a snapshot while writers are running
+  size_t size() const {
+    size_t n = 0;
+    for (size_t i = 0; i <= shard_mask_; ++i) n += shards_[i].Size();
+    return n;
+  }
+
+  bool empty() const { return size() == 0; }
+  size_t ShardNumber() const { return shard_mask_ + 1; }
+
+ private:
+  static constexpr size_t kMaxShardNum = 65536;
+  static constexpr int kShardShift = 64 - 16;
+
+  using Shard = std::conditional_t<OptimisticReads, detail::OptimisticShard<Key, Value, Hash, Eq>,
+                                   detail::LockedShard<Key, Value, Hash, Eq>>;
+
+  // neighbouring shard locks must not share a cache line
+  struct alignas(kCacheLineSize) PaddedShard : Shard {};
+
+  // high bits pick the shard, tables inside index with the low ones. An identity hash, e.g. std::hash of small
+  // integers, leaves the high bits zero, the Fibonacci multiply carries the low bits up into them
+  Shard& ShardOf(size_t hash) const {
+    return shards_[((static_cast<uint64_t>(hash) * 0x9e3779b97f4a7c15ull) >> kShardShift) & shard_mask_];
+  }
+
+  ConcurrentHashMap(const ConcurrentHashMap&) = delete;
+  ConcurrentHashMap& operator=(const ConcurrentHashMap&) = delete;
+
+  std::unique_ptr<PaddedShard[]> shards_;
+  size_t shard_mask_;
+  Hash hash_;
+};  // ConcurrentHashMap
+
+#endif  // CXXUTIL_CONCURRENT_HASH_MAP_H_
@@ -0,0 +1,508 @@
+#include "curl_downloader.h"
+
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+#include <utility>
+
+#include "model_cache.h"
+
+struct CurlDownloader::Transfer {
+  FILE* file = nullptr;
+  char error[CURL_ERROR_SIZE] = {};
+  DownloadResult result;
+  const DownloadCallback* on_done = nullptr;
+};
+
+struct CurlDownloader::Segment {
+  size_t index = 0;
+  int64_t offset = 0;
+  int64_t length = 0;
+  int64_t received = 0;
+  int attempts = 0;
+  int fd = -1;
+  char error[CURL_ERROR_SIZE] = {};
+};
+
+// contents of the state file, a marker without segments while a whole-file transfer runs
+struct CurlDownloader::SegmentState {
+  std::string url;
+  int64_t size = 0;
+  size_t segment_size = 0;
+  // '1' for each segment on disk
+  std::string done;
+  // ETag or Last-Modified of the file the segments come from
+  std::string validator;
+};
+
+CurlDownloader::CurlDownloader(const std::string& model_dir, size_t max_concurrency)
+    : model_dir_(model_dir), max_concurrency_(max_concurrency ? max_concurrency : 1) {
+  if (access(model_dir_.c_str(), W_OK) != 0) {
+    error_ = "model directory not exist or do not have write permission: " + model_dir_;
+    std::cerr << error_ << "\n";
+  }
+  curl_ = curl_easy_init();
+  curl_easy_setopt(curl_, CURLOPT_NOPROGRESS, false);
+  multi_ = curl_multi_init();
+  if (error_.empty() && (!curl_ || !multi_)) error_ = "curl initialization failed";
+}
+
+CurlDownloader::~CurlDownloader() {
+  for (CURL* easy : idle_handles_) curl_easy_cleanup(easy);
+  if (multi_) {
+    curl_multi_cleanup(multi_);
+    multi_ = nullptr;
+  }
+  if (curl_) {
+    curl_easy_cleanup(curl_);
+    curl_ = nullptr;
+  }
+}
+
+std::string CurlDownloader::GetFilePath(const std::string& model_dir, const std::string& url) {
+  // get name of model file
+  size_t pos = url.find_last_of('/');
+  return model_dir + (pos == std::string::npos ? "/" + url : url.substr(pos));
+}
+
+bool CurlDownloader::IsComplete(const std::string& file_path) {
+  return access(file_path.c_str(), F_OK) == 0 && access(GetStatePath(file_path).c_str(), F_OK) != 0;
+}
+
+bool CurlDownloader::LoadState(const std::string& file_path, SegmentState* state) {
+  std::ifstream in(GetStatePath(file_path));
+  if (!std::getline(in, state->url) || !(in >> state->size >> state->segment_size >> state->done)) return false;
+  // absent in state files of older versions, which then never match a server sending a validator
+  std::getline(in >> std::ws, state->validator);
+  return state->size > 0 && state->segment_size > 0 &&
+         state->done.size() == (state->size + state->segment_size - 1) / state->segment_size;
+}
+
+bool CurlDownloader::SaveState(const std::string& file_path, const SegmentState& state) {
+  // replaced by rename, a crash leaves either the old or the new state
+  const std::string state_path = GetStatePath(file_path);
+  const std::string tmp_path = state_path + ".tmp";
+  {
+    std::ofstream out(tmp_path, std::ios::trunc);
+    out << state.url << "\n";
+    if (!state.done.empty()) {
+      out << state.size << " " << state.segment_size << "\n" << state.done << "\n" << state.validator << "\n";
+    }
+    if (!out.flush()) return false;
+  }
+  return std::rename(tmp_path.c_str(), state_path.c_str()) == 0;
+}
+
+DownloadResult CurlDownloader::MakeInitError(const std::string& url) const {
+  DownloadResult result;
+  result.url = url;
+  result.code = CURLE_FAILED_INIT;
+  result.error = error_;
+  return result;
+}
+
+std::string CurlDownloader::Download(const std::string& url) {
+  if (cache_) return cache_->Fetch(url).file_path;
+  if (!IsValid()) return {};
+  std::string file_path = GetFilePath(url);
+
+  if (IsComplete(file_path)) {
+    std::cout << "model exists in specified directory, skip download\n";
+    return file_path;
+  }
+  SegmentState state;
+  if (LoadState(file_path, &state) && state.url == url) {
+    std::cout << "model download incomplete, resume\n";
+    return DownloadSegmented(url).file_path;
+  }
+
+  state = SegmentState();
+  state.url = url;
+  FileHandle f(file_path, "wb");
+  FILE* file = f.GetFile();
+  if (!file || !SaveState(file_path, state)) {
+    std::cerr << "can not create model file: " << file_path << "\n";
+    return {};
+  }
+
+  curl_easy_setopt(curl_, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl_, CURLOPT_WRITEDATA, file);
+  // an error page is not a model file
+  curl_easy_setopt(curl_, CURLOPT_FAILONERROR, 1L);
+
+  auto re = curl_easy_perform(curl_);
+  if (!f.Close() && re == CURLE_OK) re = CURLE_WRITE_ERROR;
+  if (re != CURLE_OK) {
+    std::cerr << "Download model error, error_code: " << re << "\n";
+    std::cerr << "model url: " << url << "\n";
+    std::remove(file_path.c_str());
+    std::remove(GetStatePath(file_path).c_str());
+    return {};
+  }
+  std::remove(GetStatePath(file_path).c_str());
+  return file_path;
+}
+
+CURL* CurlDownloader::AcquireHandle() {
+  if (idle_handles_.empty()) return curl_easy_init();
+  CURL* easy = idle_handles_.back();
+  idle_handles_.pop_back();
+  curl_easy_reset(easy);
+  return easy;
+}
+
+template <typename Job, typename StartFunc, typename FinishFunc>
+void CurlDownloader::RunTransfers(std::deque<Job*>* pending, StartFunc&& start, FinishFunc&& finish) {
+  std::vector<CURL*> active;
+  auto complete = [&](CURL* easy, CURLcode code) {
+    Job* job = nullptr;
+    curl_easy_getinfo(easy, CURLINFO_PRIVATE, &job);
+    curl_multi_remove_handle(multi_, easy);
+    active.erase(std::find(active.begin(), active.end(), easy));
+    finish(job, easy, code);
+    idle_handles_.push_back(easy);
+  };
+
+  int running = 0;
+  while (!active.empty() || !pending->empty()) {
+    while (active.size() < max_concurrency_ && !pending->empty()) {
+      Job* job = pending->front();
+      pending->pop_front();
+      CURL* easy = AcquireHandle();
+      if (!start(job, easy)) {
+        idle_handles_.push_back(easy);
+        continue;
+      }
+      curl_easy_setopt(easy, CURLOPT_PRIVATE, job);
+      curl_multi_add_handle(multi_, easy);
+      active.push_back(easy);
+    }
+
+    CURLMcode mc = curl_multi_perform(multi_, &running);
+    int queued = 0;
+    while (CURLMsg* msg = curl_multi_info_read(multi_, &queued)) {
+      if (msg->msg == CURLMSG_DONE) complete(msg->easy_handle, msg->data.result);
+    }
+    if (mc != CURLM_OK) {
+      // the multi handle is unusable, fail what is left
+      std::cerr << "curl multi error: " << curl_multi_strerror(mc) << "\n";
+      while (!active.empty()) complete(active.back(), CURLE_FAILED_INIT);
+      std::deque<Job*> dropped;
+      dropped.swap(*pending);
+      for (Job* job : dropped) finish(job, nullptr, CURLE_FAILED_INIT);
+      pending->clear();
+      return;
+    }
+    // a finished transfer freed a slot, start the next one before waiting
+    if (running && !(active.size() < max_concurrency_ && !pending->empty())) {
+      curl_multi_poll(multi_, nullptr, 0, 1000, nullptr);
+    }
+  }
+}
+
+std::vector<DownloadResult> CurlDownloader::DownloadBatch(const std::vector<std::string>& urls,
+                                                          const DownloadCallback& on_done) {
+  if (!IsValid()) {
+    std::vector<DownloadResult> results;
+    for (const std::string& url : urls) {
+      results.push_back(MakeInitError(url));
+      if (on_done) on_done(results.back());
+    }
+    return results;
+  }
+  std::vector<Transfer> transfers(urls.size());
+  std::deque<Transfer*> pending;
+  // file path -> index of the transfer writing it, two transfers of one file would corrupt it
+  std::unordered_map<std::string, size_t> owners;
+  // (index, owner index) of repeated urls, they get the result of the owner
+  std::vector<std::pair<size_t, size_t>> repeats;
+  for (size_t i = 0; i < urls.size(); ++i) {
+    Transfer& t = transfers[i];
+    t.result.url = urls[i];
+    t.on_done = &on_done;
+    std::string file_path = GetFilePath(urls[i]);
+    auto owner = owners.emplace(file_path, i);
+    if (!owner.second) {
+      const std::string& owner_url = transfers[owner.first->second].result.url;
+      if (owner_url == urls[i]) {
+        repeats.emplace_back(i, owner.first->second);
+      } else {
+        t.result.code = CURLE_WRITE_ERROR;
+        t.result.error = file_path + " is also the file of " + owner_url;
+        if (on_done) on_done(t.result);
+      }
+      continue;
+    }
+    if (IsComplete(file_path)) {
+      t.result.file_path = std::move(file_path);
+      if (on_done) on_done(t.result);
+    } else {
+      pending.push_back(&t);
+    }
+  }
+
+  RunTransfers(
+      &pending, [this](Transfer* t, CURL* easy) { return StartTransfer(t, easy); },
+      [this](Transfer* t, CURL* easy, CURLcode code) { FinishTransfer(t, easy, code); });
+  for (const auto& repeat : repeats) {
+    transfers[repeat.first].result = transfers[repeat.second].result;
+    if (on_done) on_done(transfers[repeat.first].result);
+  }
+
+  std::vector<DownloadResult> results;
+  results.reserve(transfers.size());
+  for (Transfer& t : transfers) results.push_back(std::move(t.result));
+  return results;
+}
+
+bool CurlDownloader::StartTransfer(Transfer* transfer, CURL* easy) {
+  const std::string file_path = GetFilePath(transfer->result.url);
+  SegmentState marker;
+  marker.url = transfer->result.url;
+  transfer->file = fopen(file_path.c_str(), "wb");
+  if (!transfer->file || !SaveState(file_path, marker)) {
+    if (transfer->file) fclose(transfer->file);
+    transfer->file = nullptr;
+    transfer->result.code = CURLE_WRITE_ERROR;
+    transfer->result.error = "can not open " + file_path;
+    if (*transfer->on_done) (*transfer->on_done)(transfer->result);
+    return false;
+  }
+
+  curl_easy_setopt(easy, CURLOPT_URL, transfer->result.url.c_str());
+  curl_easy_setopt(easy, CURLOPT_WRITEDATA, transfer->file);
+  curl_easy_setopt(easy, CURLOPT_ERRORBUFFER, transfer->error);
+  curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
+  // an error page is not a model file
+  curl_easy_setopt(easy, CURLOPT_FAILONERROR, 1L);
+  return true;
+}
+
+void CurlDownloader::FinishTransfer(Transfer* transfer, CURL* easy, CURLcode code) {
+  const std::string file_path = GetFilePath(transfer->result.url);
+  if (!transfer->file) {
+    // dropped before it started
+    transfer->result.code = code;
+    transfer->result.error = curl_easy_strerror(code);
+    if (*transfer->on_done) (*transfer->on_done)(transfer->result);
+    return;
+  }
+  if (easy) curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &transfer->result.http_status);
+  bool written = fclose(transfer->file) == 0;
+  transfer->file = nullptr;
+  if (code == CURLE_OK && !written) code = CURLE_WRITE_ERROR;
+  transfer->result.code = code;
+  if (code == CURLE_OK) {
+    transfer->result.file_path = file_path;
+  } else {
+    transfer->result.error = transfer->error[0] ? transfer->error : curl_easy_strerror(code);
+    std::remove(file_path.c_str());
+  }
+  std::remove(GetStatePath(file_path).c_str());
+  if (*transfer->on_done) (*transfer->on_done)(transfer->result);
+}
+
+namespace {
+struct HeadHeaders {
+  bool accept_ranges = false;
+  std::string etag;
+  std::string last_modified;
+};
+
+// value of the header "name: value\r\n" if line is that header, name given in lower case with the colon
+bool HeaderValue(const char* line, size_t len, const char* name, std::string* value) {
+  const size_t name_len = strlen(name);
+  if (len < name_len || strncasecmp(line, name, name_len) != 0) return false;
+  value->assign(line + name_len, len - name_len);
+  value->erase(0, value->find_first_not_of(" \t"));
+  value->erase(value->find_last_not_of(" \t\r\n") + 1);
+  return true;
+}
+}  // namespace
+
+CURLcode CurlDownloader::QuerySize(const std::string& url, DownloadResult* result, int64_t* size,
+                                   bool* accept_ranges, std::string* validator) {
+  CURL* easy = AcquireHandle();
+  char error[CURL_ERROR_SIZE] = {};
+  HeadHeaders headers;
+  curl_easy_setopt(easy, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(easy, CURLOPT_NOBODY, 1L);
+  curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(easy, CURLOPT_FAILONERROR, 1L);
+  curl_easy_setopt(easy, CURLOPT_ERRORBUFFER, error);
+  curl_easy_setopt(easy, CURLOPT_HEADERDATA, &headers);
+  curl_easy_setopt(easy, CURLOPT_HEADERFUNCTION,
+                   static_cast<curl_write_callback>([](char* line, size_t size, size_t nmemb, void* userdata) {
+                     const size_t len = size * nmemb;
+                     HeadHeaders* h = static_cast<HeadHeaders*>(userdata);
+                     std::string value;
+                     if (HeaderValue(line, len, "accept-ranges:", &value)) {
+                       h->accept_ranges = value.find("bytes") != std::string::npos;
+                     } else if (!HeaderValue(line, len, "etag:", &h->etag)) {
+                       HeaderValue(line, len, "last-modified:", &h->last_modified);
+                     }
+                     return len;
+                   }));
+
+  CURLcode code = curl_easy_perform(easy);
+  curl_off_t length = -1;
+  curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &result->http_status);
+  curl_easy_getinfo(easy, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+  idle_handles_.push_back(easy);
+  *size = length;
+  *accept_ranges = headers.accept_ranges;
+  // If-Range takes no weak ETag
+  bool strong_etag = !headers.etag.empty() && headers.etag.compare(0, 2, "W/") != 0;
+  *validator = strong_etag ? headers.etag : headers.last_modified;
+  if (code != CURLE_OK) {
+    result->code = code;
+    result->error = error[0] ? error : curl_easy_strerror(code);
+  }
+  return code;
+}
+
+DownloadResult CurlDownloader::DownloadSegmented(const std::string& url) {
+  if (!IsValid()) return MakeInitError(url);
+  DownloadResult result;
+  result.url = url;
+  const std::string file_path = GetFilePath(url);
+  if (IsComplete(file_path)) {
+    result.file_path = file_path;
+    return result;
+  }
+
+  int64_t size = -1;
+  bool accept_ranges = false;
+  std::string validator;
+  if (QuerySize(url, &result, &size, &accept_ranges, &validator) != CURLE_OK) return result;
+  if (!accept_ranges || size <= static_cast<int64_t>(segment_size_)) return DownloadBatch({url})[0];
+
+  SegmentState state;
+  bool resume = LoadState(file_path, &state) && state.url == url && state.size == size &&
+                state.validator == validator;
+  int fd = open(file_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    result.code = CURLE_WRITE_ERROR;
+    result.error = "can not open " + file_path + ": " + std::strerror(errno);
+    return result;
+  }
+  // a file truncated or replaced since the state was saved does not hold the segments marked done
+  struct stat st;
+  if (resume && (fstat(fd, &st) != 0 || st.st_size != state.size)) resume = false;
+  if (!resume) {
+    state.url = url;
+    state.size = size;
+    state.segment_size = segment_size_;
+    state.done.assign((size + segment_size_ - 1) / segment_size_, '0');
+    state.validator = validator;
+    // blocks reserved up front, so segments land in place and a full disk shows now instead of midway
+    bool allocated = fallocate(fd, 0, 0, size) == 0 || errno == EOPNOTSUPP;
+    if (!allocated || ftruncate(fd, size) != 0 || !SaveState(file_path, state)) {
+      result.code = CURLE_WRITE_ERROR;
+      result.error = "can not allocate " + file_path + ": " + std::strerror(errno);
+      close(fd);
+      return result;
+    }
+  }
+
+  std::vector<Segment> segments;
+  for (size_t i = 0; i < state.done.size(); ++i) {
+    if (state.done[i] == '1') continue;
+    Segment seg;
+    seg.index = i;
+    seg.offset = static_cast<int64_t>(i * state.segment_size);
+    seg.length = std::min<int64_t>(state.segment_size, size - seg.offset);
+    seg.fd = fd;
+    segments.push_back(seg);
+  }
+  std::deque<Segment*> pending;
+  for (Segment& seg : segments) pending.push_back(&seg);
+  // a server whose file no longer matches the validator answers 200 with the whole new file
+  curl_slist* if_range = validator.empty() ? nullptr : curl_slist_append(nullptr, ("If-Range: " + validator).c_str());
+  bool changed = false;
+
+  auto start = [&url, if_range](Segment* seg, CURL* easy) {
+    seg->received = 0;
+    seg->error[0] = '\0';
+    const std::string range = std::to_string(seg->offset) + "-" + std::to_string(seg->offset + seg->length - 1);
+    curl_easy_setopt(easy, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(easy, CURLOPT_RANGE, range.c_str());
+    curl_easy_setopt(easy, CURLOPT_HTTPHEADER, if_range);
+    curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(easy, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(easy, CURLOPT_ERRORBUFFER, seg->error);
+    curl_easy_setopt(easy, CURLOPT_WRITEDATA, seg);
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION,
+                     static_cast<curl_write_callback>([](char* data, size_t size, size_t nmemb, void* userdata) {
+                       Segment* s = static_cast<Segment*>(userdata);
+                       size_t len = size * nmemb;
+                       // a server ignoring the range sends the whole file, stop before it overruns the segment
+                       if (s->received + static_cast<int64_t>(len) > s->length) return size_t(0);
+                       for (size_t done = 0; done < len;) {
+                         ssize_t n = pwrite(s->fd, data + done, len - done, s->offset + s->received);
+                         if (n < 0 && errno == EINTR) continue;
+                         if (n <= 0) return size_t(0);
+                         done += n;
+                         s->received += n;
+                       }
+                       return len;
+                     }));
+    return true;
+  };
+  auto finish = [&](Segment* seg, CURL* easy, CURLcode code) {
+    long status = 0;
+    if (easy) curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &status);
+    if (if_range && status == 200) {
+      // retrying cannot help, the segments on disk belong to the old file
+      changed = true;
+      pending.clear();
+      result.code = CURLE_RANGE_ERROR;
+      result.http_status = status;
+      result.error = url + " changed during the download";
+      return;
+    }
+    if (code == CURLE_OK && status != 206) code = CURLE_RANGE_ERROR;
+    if (code == CURLE_OK && seg->received != seg->length) code = CURLE_PARTIAL_FILE;
+    // the data must be on disk before the state file says so
+    if (code == CURLE_OK && fdatasync(fd) != 0) code = CURLE_WRITE_ERROR;
+    if (code == CURLE_OK) {
+      state.done[seg->index] = '1';
+      // a failed save only costs refetching the segment after a restart
+      SaveState(file_path, state);
+      return;
+    }
+    if (easy && ++seg->attempts <= max_retries_) {
+      pending.push_back(seg);
+      return;
+    }
+    result.code = code;
+    result.http_status = status;
+    result.error = seg->error[0] ? seg->error : curl_easy_strerror(code);
+  };
+  RunTransfers(&pending, start, finish);
+  close(fd);
+  curl_slist_free_all(if_range);
+
+  if (changed) {
+    // the next call starts over, the file goes first as without a state file it would pass for complete
+    std::remove(file_path.c_str());
+    std::remove(GetStatePath(file_path).c_str());
+    return result;
+  }
+  if (state.done.find('0') != std::string::npos) return result;
+  std::remove(GetStatePath(file_path).c_str());
+  result.code = CURLE_OK;
+  result.http_status = 206;
+  result.error.clear();
+  result.file_path = file_path;
+  return result;
+}
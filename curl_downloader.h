@@ -0,0 +1,182 @@
+/**
+ * @file curl_downloader.h
+ *
+ * This file contains a declaration of CurlDownloader, which fetches model files into a local directory.
+ */
+
+#ifndef CXXUTIL_CURL_DOWNLOADER_H_
+#define CXXUTIL_CURL_DOWNLOADER_H_
+
+#include <curl/curl.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Outcome of one transfer of CurlDownloader::DownloadBatch
+ */
+struct DownloadResult {
+  std::string url;
+  // where the file is, empty on failure
+  std::string file_path;
+  CURLcode code = CURLE_OK;
+  // 0 when nothing was transferred, e.g. the file already existed
+  long http_status = 0;
+  std::string error;
+
+  bool ok() const { return !file_path.empty(); }
+};
+
+using DownloadCallback = std::function<void(const DownloadResult&)>;
+
+class ModelCache;
+
+/**
+ * @brief Downloads files named after the last path segment of their url into model_dir, skipping complete files
+ *
+ * Download fetches one file with a blocking transfer. DownloadBatch runs many transfers at once on one curl_multi
+ * event loop in the calling thread, with at most max_concurrency in flight, and reuses connections to the same host.
+ * DownloadSegmented splits one large file into Range requests run the same way.
+ *
+ * While a file is being written a state file `<file>.part` sits next to it, so a file left by a crash or a failed
+ * segmented download is known to be incomplete. Download and DownloadSegmented resume such a file from the segments
+ * already written. With a ModelCache set, Download serves files from the cache instead, see SetCache.
+ * Not thread-safe, use one downloader per thread.
+ */
+class CurlDownloader {
+ public:
+  static constexpr size_t kDefaultMaxConcurrency = 8;
+  static constexpr size_t kDefaultSegmentSize = 8 << 20;
+  static constexpr int kDefaultMaxRetries = 3;
+
+  explicit CurlDownloader(const std::string& model_dir, size_t max_concurrency = kDefaultMaxConcurrency);
+  ~CurlDownloader();
+
+  CurlDownloader(const CurlDownloader&) = delete;
+  CurlDownloader& operator=(const CurlDownloader&) = delete;
+
+  /**
+   * @brief false if model_dir is missing or not writable or curl failed to start, every download then fails with
+   * GetError as error
+   */
+  bool IsValid() const { return error_.empty(); }
+  const std::string& GetError() const { return error_; }
+
+  /**
+   * @return path of the downloaded file, empty on failure
+   */
+  std::string Download(const std::string& url);
+
+  /**
+   * @brief Downloads one file over up to max_concurrency parallel Range requests of segment_size bytes
+   *
+   * The size comes from a HEAD request. The file is preallocated, each segment is written at its offset and
+   * recorded in the state file once on disk. A failed segment is retried max_retries times, if it still fails the
+   * written segments are kept and the next call continues from them. Servers without range support, and files of
+   * one segment, are fetched in a single request.
+   *
+   * The ETag or Last-Modified of the HEAD is kept in the state file and sent as If-Range with every segment. A call
+   * seeing another validator than the state file starts over, a file changed midway fails and is removed.
+   */
+  DownloadResult DownloadSegmented(const std::string& url);
+
+  /**
+   * @brief Downloads all urls concurrently, returns when every transfer has finished
+   *
+   * on_done, when set, is called in the calling thread as each transfer completes, in completion order.
+   * A failed transfer leaves no file behind. A url given twice is fetched once, a url whose file name is already
+   * taken by another url of the batch fails with CURLE_WRITE_ERROR.
+   *
+   * @return results in the order of urls
+   */
+  std::vector<DownloadResult> DownloadBatch(const std::vector<std::string>& urls,
+                                            const DownloadCallback& on_done = nullptr);
+
+  void SetMaxConcurrency(size_t max_concurrency) { max_concurrency_ = max_concurrency ? max_concurrency : 1; }
+  size_t GetMaxConcurrency() const { return max_concurrency_; }
+  void SetSegmentSize(size_t segment_size) { segment_size_ = segment_size ? segment_size : kDefaultSegmentSize; }
+  size_t GetSegmentSize() const { return segment_size_; }
+  void SetMaxRetries(int max_retries) { max_retries_ = max_retries; }
+  int GetMaxRetries() const { return max_retries_; }
+
+  /**
+   * @brief Download goes through cache, which checks the version on the server, instead of trusting any file of the
+   * same name in model_dir. The returned path is then inside the cache. nullptr to go back, the cache must outlive
+   * this downloader
+   */
+  void SetCache(ModelCache* cache) { cache_ = cache; }
+
+  /**
+   * @return whether file_path exists and no download of it is unfinished
+   */
+  static bool IsComplete(const std::string& file_path);
+
+  /**
+   * @brief Where a downloader of model_dir puts url, urls of the same last path segment share a file
+   */
+  static std::string GetFilePath(const std::string& model_dir, const std::string& url);
+
+ private:
+  class FileHandle {
+   public:
+    explicit FileHandle(const std::string& fpath, const char* mode) {
+      file_ = fopen(fpath.c_str(), mode);
+    }
+    FILE* GetFile() {return file_;}
+    // false if buffered data could not be written
+    bool Close() {
+      bool closed = file_ && fclose(file_) == 0;
+      file_ = nullptr;
+      return closed;
+    }
+    ~FileHandle() {
+      if (file_) fclose(file_);
+    }
+
+   private:
+    FILE* file_ = nullptr;
+  };  // class FileHandle
+
+  struct Transfer;
+  struct Segment;
+  struct SegmentState;
+
+  std::string GetFilePath(const std::string& url) const { return GetFilePath(model_dir_, url); }
+  DownloadResult MakeInitError(const std::string& url) const;
+  static std::string GetStatePath(const std::string& file_path) { return file_path + ".part"; }
+  static bool LoadState(const std::string& file_path, SegmentState* state);
+  static bool SaveState(const std::string& file_path, const SegmentState& state);
+
+  CURL* AcquireHandle();
+  // drives multi_ until pending is empty and nothing is in flight, at most max_concurrency_ at once.
+  // start sets up a pooled handle for the job, false if the job failed to start. finish gets every job that ran,
+  // after its handle left multi_, and may push it back to pending to retry it. If multi_ itself fails, the jobs
+  // not finished get finish with a nullptr handle, and are not retried
+  template <typename Job, typename StartFunc, typename FinishFunc>
+  void RunTransfers(std::deque<Job*>* pending, StartFunc&& start, FinishFunc&& finish);
+  // validator is the strong ETag, else Last-Modified, empty if the server sends neither
+  CURLcode QuerySize(const std::string& url, DownloadResult* result, int64_t* size, bool* accept_ranges,
+                     std::string* validator);
+  // false when the transfer failed before starting, on_done has been called then
+  bool StartTransfer(Transfer* transfer, CURL* easy);
+  void FinishTransfer(Transfer* transfer, CURL* easy, CURLcode code);
+
+  std::string model_dir_;
+  // why the downloader is unusable, empty if it is fine
+  std::string error_;
+  size_t max_concurrency_;
+  size_t segment_size_ = kDefaultSegmentSize;
+  int max_retries_ = kDefaultMaxRetries;
+  ModelCache* cache_ = nullptr;
+  CURL* curl_ = nullptr;
+  CURLM* multi_ = nullptr;
+  // easy handles of finished batch transfers, kept for the next ones
+  std::vector<CURL*> idle_handles_;
+};  // class CurlDownloader
+
+#endif  // CXXUTIL_CURL_DOWNLOADER_H_
@@ -0,0 +1,160 @@
+/**
+ * @file delegate.h
+ *
+ * This file contains a declaration of the Delegate class, a fixed-size callable wrapper which never allocates.
+ */
+
+#ifndef CXXUTIL_DELEGATE_H_
+#define CXXUTIL_DELEGATE_H_
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+template <typename Signature, std::size_t Capacity = 4 * sizeof(void*)>
+class Delegate;
+
+/**
+ * @brief Type-erased callable stored inline in a buffer of `Capacity` bytes.
+ *
+ * Holds a free function, an object pointer plus member function, or a small functor (lambda, std::function...).
+ * Functors larger than `Capacity` are rejected at compile time instead of falling back to the heap.
+ * Trivially copyable targets (function pointers, member bindings, capture-by-reference lambdas) are copied with
+ * memcpy and need no destructor call.
+ */
+template <typename R, typename... Args, std::size_t Capacity>
+class Delegate<R(Args...), Capacity> {
+ public:
+  static constexpr std::size_t capacity = Capacity;
+
+  Delegate() noexcept = default;
+  Delegate(std::nullptr_t) noexcept {}  // NOLINT
+
+  /**
+   * @brief Bind a member function to an object, the object must outlive the delegate
+   */
+  template <typename C>
+  Delegate(C* obj, R (C::*method)(Args...)) noexcept {
+    Construct<MemberBinding<C, R (C::*)(Args...)>>({obj, method});
+  }
+
+  template <typename C>
+  Delegate(const C* obj, R (C::*method)(Args...) const) noexcept {
+    Construct<MemberBinding<const C, R (C::*)(Args...) const>>({obj, method});
+  }
+
+  /**
+   * @brief Bind a free function or a functor, the functor is stored inline
+   */
+  template <typename F, typename Fn = typename std::decay<F>::type,
+            typename = typename std::enable_if<!std::is_same<Fn, Delegate>::value>::type,
+            typename = decltype(static_cast<R>(std::declval<Fn&>()(std::declval<Args>()...)))>
+  Delegate(F&& func) noexcept(std::is_nothrow_constructible<Fn, F&&>::value) {  // NOLINT
+    Construct<Fn>(std::forward<F>(func));
+  }
+
+  Delegate(const Delegate& other) { CopyFrom(other); }
+  Delegate(Delegate&& other) noexcept { MoveFrom(&other); }
+
+  Delegate& operator=(const Delegate& other) {
+    if (this != &other) {
+      Reset();
+      CopyFrom(other);
+    }
+    return *this;
+  }
+
+  Delegate& operator=(Delegate&& other) noexcept {
+    if (this != &other) {
+      Reset();
+      MoveFrom(&other);
+    }
+    return *this;
+  }
+
+  ~Delegate() { Reset(); }
+
+  R operator()(Args... args) const { return invoke_(&storage_, std::forward<Args>(args)...); }
+
+  explicit operator bool() const noexcept { return invoke_ != nullptr; }
+
+  void Reset() noexcept {
+    if (manage_) manage_(Op::DESTROY, &storage_, nullptr);
+    invoke_ = nullptr;
+    manage_ = nullptr;
+  }
+
+ private:
+  using Storage = typename std::aligned_storage<Capacity, alignof(std::max_align_t)>::type;
+  enum class Op { COPY, MOVE, DESTROY };
+  using Invoker = R (*)(const Storage*, Args&&...);
+  using Manager = void (*)(Op, Storage*, Storage*);
+
+  template <typename C, typename M>
+  struct MemberBinding {
+    R operator()(Args... args) const { return (obj->*method)(std::forward<Args>(args)...); }
+    C* obj;
+    M method;
+  };
+
+  template <typename Fn>
+  static R Invoke(const Storage* storage, Args&&... args) {
+    return static_cast<R>((*const_cast<Fn*>(reinterpret_cast<const Fn*>(storage)))(std::forward<Args>(args)...));
+  }
+
+  template <typename Fn>
+  static void Manage(Op op, Storage* dst, Storage* src) {
+    switch (op) {
+      case Op::COPY:
+        new (dst) Fn(*reinterpret_cast<const Fn*>(src));
+        break;
+      case Op::MOVE:
+        new (dst) Fn(std::move(*reinterpret_cast<Fn*>(src)));
+        reinterpret_cast<Fn*>(src)->~Fn();
+        break;
+      case Op::DESTROY:
+        reinterpret_cast<Fn*>(dst)->~Fn();
+        break;
+    }
+  }
+
+  template <typename Fn, typename F = Fn&&>
+  void Construct(F&& func) {
+    static_assert(sizeof(Fn) <= Capacity, "callable is too large to store inline, increase Delegate capacity");
+    static_assert(alignof(Fn) <= alignof(Storage), "callable is over-aligned for Delegate storage");
+    static_assert(std::is_nothrow_move_constructible<Fn>::value, "callable must be nothrow move constructible");
+    new (&storage_) Fn(std::forward<F>(func));
+    invoke_ = &Invoke<Fn>;
+    manage_ = std::is_trivially_copyable<Fn>::value ? nullptr : &Manage<Fn>;
+  }
+
+  void CopyFrom(const Delegate& other) {
+    if (other.manage_) {
+      other.manage_(Op::COPY, &storage_, const_cast<Storage*>(&other.storage_));
+    } else {
+      std::memcpy(&storage_, &other.storage_, sizeof(Storage));
+    }
+    invoke_ = other.invoke_;
+    manage_ = other.manage_;
+  }
+
+  void MoveFrom(Delegate* other) noexcept {
+    if (other->manage_) {
+      other->manage_(Op::MOVE, &storage_, &other->storage_);
+    } else {
+      std::memcpy(&storage_, &other->storage_, sizeof(Storage));
+    }
+    invoke_ = other->invoke_;
+    manage_ = other->manage_;
+    other->invoke_ = nullptr;
+    other->manage_ = nullptr;
+  }
+
+  Storage storage_;
+  Invoker invoke_ = nullptr;
+  Manager manage_ = nullptr;
+};  // class Delegate
+
+#endif  // CXXUTIL_DELEGATE_H_
@@ -0,0 +1,520 @@
+/**
+ * @file flat_hash_map.h
+ *
+ * This file contains a declaration of FlatHashMap, an open-addressing hash map with SIMD-probed control bytes
+ * (Swiss table), and FlatHash, its default hasher.
+ */
+
+#ifndef CXXUTIL_FLAT_HASH_MAP_H_
+#define CXXUTIL_FLAT_HASH_MAP_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#if !defined(CXXUTIL_FLAT_HASH_PORTABLE) && (defined(__SSE2__) || defined(__AVX2__))
+#include <immintrin.h>
+#endif
+
+/**
+ * @brief Default hasher of FlatHashMap
+ *
+ * std::hash of integers is the identity, which puts all entropy in the low bits, so the result is mixed with the
+ * murmur3 finalizer: FlatHashMap uses the low 7 bits and the rest separately.
+ * Strings are hashed as std::string_view, so `std::string`, `std::string_view` and `const char*` lookups agree.
+ */
+template <typename Key>
+struct FlatHash {
+  size_t operator()(const Key& key) const noexcept { return Mix(std::hash<Key>{}(key)); }
+
+  static size_t Mix(size_t h) noexcept {
+    uint64_t x = h;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    return static_cast<size_t>(x);
+  }
+};
+
+template <>
+struct FlatHash<std::string> {
+  using is_transparent = void;
+  size_t operator()(std::string_view key) const noexcept {
+    return FlatHash<size_t>::Mix(std::hash<std::string_view>{}(key));
+  }
+};
+
+template <>
+struct FlatHash<std::string_view> : FlatHash<std::string> {};
+
+namespace detail {
+
+using ctrl_t = int8_t;
+// full slots hold the low 7 bits of the hash, 0 ~ 127
+constexpr ctrl_t kCtrlEmpty = -128;    // 0b10000000
+constexpr ctrl_t kCtrlDeleted = -2;    // 0b11111110
+constexpr ctrl_t kCtrlSentinel = -1;   // 0b11111111, stops iteration at the end of the table
+
+inline bool IsFull(ctrl_t c) { return c >= 0; }
+
+// set bits of a group match, `Shift` is log2 of bits per slot
+template <typename T, int Shift>
+class BitMask {
+ public:
+  explicit BitMask(T mask) : mask_(mask) {}
+  explicit operator bool() const { return mask_ != 0; }
+  int LowestBit() const { return __builtin_ctzll(static_cast<uint64_t>(mask_)) >> Shift; }
+  void ClearLowest() { mask_ &= mask_ - 1; }
+
+ private:
+  T mask_;
+};
+
+#if !defined(CXXUTIL_FLAT_HASH_PORTABLE) && defined(__AVX2__)
+struct Group {
+  static constexpr size_t kWidth = 32;
+  using Mask = BitMask<uint32_t, 0>;
+
+  explicit Group(const ctrl_t* pos) : ctrl(_mm256_load_si256(reinterpret_cast<const __m256i*>(pos))) {}
+
+  Mask Match(ctrl_t h2) const {
+    return Mask(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_set1_epi8(h2), ctrl))));
+  }
+  Mask MatchEmpty() const { return Match(kCtrlEmpty); }
+  Mask MatchEmptyOrDeleted() const {
+    __m256i special = _mm256_cmpgt_epi8(_mm256_set1_epi8(kCtrlSentinel), ctrl);
+    return Mask(static_cast<uint32_t>(_mm256_movemask_epi8(special)));
+  }
+
+  __m256i ctrl;
+};
+#elif !defined(CXXUTIL_FLAT_HASH_PORTABLE) && defined(__SSE2__)
+struct Group {
+  static constexpr size_t kWidth = 16;
+  using Mask = BitMask<uint32_t, 0>;
+
+  explicit Group(const ctrl_t* pos) : ctrl(_mm_load_si128(reinterpret_cast<const __m128i*>(pos))) {}
+
+  Mask Match(ctrl_t h2) const {
+    return Mask(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl))));
+  }
+  Mask MatchEmpty() const { return Match(kCtrlEmpty); }
+  Mask MatchEmptyOrDeleted() const {
+    __m128i special = _mm_cmpgt_epi8(_mm_set1_epi8(kCtrlSentinel), ctrl);
+    return Mask(static_cast<uint32_t>(_mm_movemask_epi8(special)));
+  }
+
+  __m128i ctrl;
+};
+#else
+// 8 control bytes in a word, the high bit of each byte is the result
+struct Group {
+  static constexpr size_t kWidth = 8;
+  using Mask = BitMask<uint64_t, 3>;
+  static constexpr uint64_t kLsbs = 0x0101010101010101ull;
+  static constexpr uint64_t kMsbs = 0x8080808080808080ull;
+
+  explicit Group(const ctrl_t* pos) { std::memcpy(&ctrl, pos, sizeof(ctrl)); }
+
+  // may report a false positive next to a real match, callers compare keys anyway
+  Mask Match(ctrl_t h2) const {
+    uint64_t x = ctrl ^ (kLsbs * static_cast<uint8_t>(h2));
+    return Mask((x - kLsbs) & ~x & kMsbs);
+  }
+  Mask MatchEmpty() const { return Mask((ctrl & ~(ctrl << 6)) & kMsbs); }
+  Mask MatchEmptyOrDeleted() const { return Mask((ctrl & ~(ctrl << 7)) & kMsbs); }
+
+  uint64_t ctrl;
+};
+#endif
+
+}  // namespace detail
+
+/**
+ * @brief Open-addressing hash map storing elements in one contiguous slot array (Swiss table)
+ *
+ * Every slot has a control byte holding 7 bits of the hash, or empty / deleted. Lookup loads a group of control
+ * bytes (16 with SSE2, 32 with AVX2, 8 in the portable fallback) and compares all of them at once, so keys are only
+ * compared for slots whose 7-bit tag matches. Groups are probed quadratically, the table grows at 7/8 load.
+ *
+ * Heterogeneous lookup: find / count / contains / erase accept any type that Hash and Eq accept, with the default
+ * FlatHash<std::string> and std::equal_to<> a `std::string_view` or `const char*` looks up without building a string.
+ *
+ * Differences from std::unordered_map: insertion and rehash invalidate iterators and references,
+ * the key type must be nothrow move constructible.
+ */
+template <typename Key, typename Value, typename Hash = FlatHash<Key>, typename Eq = std::equal_to<>>
+class FlatHashMap {
+  // slots hold mutable pairs so that rehash can move keys, the public view has a const key.
+  // the two are layout-compatible, the same approach as libc++ unordered_map nodes
+  using slot_type = std::pair<Key, Value>;
+
+ public:
+  using key_type = Key;
+  using mapped_type = Value;
+  using value_type = std::pair<const Key, Value>;
+  using size_type = size_t;
+  using hasher = Hash;
+  using key_equal = Eq;
+
+  template <bool Const>
+  class Iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = FlatHashMap::value_type;
+    using difference_type = std::ptrdiff_t;
+    using reference = typename std::conditional<Const, const value_type&, value_type&>::type;
+    using pointer = typename std::conditional<Const, const value_type*, value_type*>::type;
+
+    Iterator() = default;
+    // iterator -> const_iterator
+    template <bool C = Const, typename = typename std::enable_if<C>::type>
+    Iterator(const Iterator<false>& other) : ctrl_(other.ctrl_), slot_(other.slot_) {}  // NOLINT
+
+    reference operator*() const { return *operator->(); }
+    pointer operator->() const { return reinterpret_cast<pointer>(slot_); }
+
+    Iterator& operator++() {
+      ++ctrl_;
+      ++slot_;
+      SkipEmpty();
+      return *this;
+    }
+    Iterator operator++(int) {
+      Iterator tmp = *this;
+      ++*this;
+      return tmp;
+    }
+
+    friend bool operator==(const Iterator& a, const Iterator& b) { return a.ctrl_ == b.ctrl_; }
+    friend bool operator!=(const Iterator& a, const Iterator& b) { return a.ctrl_ != b.ctrl_; }
+
+   private:
+    friend class FlatHashMap;
+    template <bool>
+    friend class Iterator;
+
+    Iterator(const detail::ctrl_t* ctrl, slot_type* slot) : ctrl_(ctrl), slot_(slot) {}
+
+    // the sentinel after the last slot stops the scan
+    void SkipEmpty() {
+      while (*ctrl_ < detail::kCtrlSentinel) {
+        ++ctrl_;
+        ++slot_;
+      }
+    }
+
+    const detail::ctrl_t* ctrl_ = nullptr;
+    slot_type* slot_ = nullptr;
+  };
+
+  using iterator = Iterator<false>;
+  using const_iterator = Iterator<true>;
+
+  FlatHashMap() = default;
+  explicit FlatHashMap(size_t capacity, const Hash& hash = Hash(), const Eq& eq = Eq()) : hash_(hash), eq_(eq) {
+    reserve(capacity);
+  }
+  FlatHashMap(std::initializer_list<value_type> init) {
+    reserve(init.size());
+    for (const auto& v : init) insert(v);
+  }
+
+  FlatHashMap(const FlatHashMap& other) : hash_(other.hash_), eq_(other.eq_) {
+    reserve(other.size());
+    for (const auto& v : other) EmplaceNew(v.first, v.second);
+  }
+  FlatHashMap(FlatHashMap&& other) noexcept { Swap(other); }
+
+  FlatHashMap& operator=(const FlatHashMap& other) {
+    if (this != &other) {
+      FlatHashMap tmp(other);
+      Swap(tmp);
+    }
+    return *this;
+  }
+  FlatHashMap& operator=(FlatHashMap&& other) noexcept {
+    if (this != &other) {
+      FlatHashMap tmp(std::move(other));
+      Swap(tmp);
+    }
+    return *this;
+  }
+
+  ~FlatHashMap() { Release(); }
+
+  iterator begin() {
+    iterator it(ctrl_, slots_);
+    it.SkipEmpty();
+    return it;
+  }
+  iterator end() { return iterator(ctrl_ + capacity_, slots_ + capacity_); }
+  const_iterator begin() const { return const_cast<FlatHashMap*>(this)->begin(); }
+  const_iterator end() const { return const_cast<FlatHashMap*>(this)->end(); }
+  const_iterator cbegin() const { return begin(); }
+  const_iterator cend() const { return end(); }
+
+  bool empty() const noexcept { return size_ == 0; }
+  size_t size() const noexcept { return size_; }
+  size_t capacity() const noexcept { return capacity_; }
+
+  void clear() {
+    DestroySlots();
+    if (capacity_) ResetCtrl();
+    size_ = 0;
+    deleted_ = 0;
+  }
+
+  /**
+   * @brief Make room for `count` elements without rehash
+   */
+  void reserve(size_t count) {
+    size_t capacity = detail::Group::kWidth;
+    while (capacity * 7 / 8 < count) capacity <<= 1;
+    if (capacity > capacity_) Resize(capacity);
+  }
+
+  template <typename K>
+  iterator find(const K& key) {
+    size_t idx = Find(key, hash_(key));
+    return idx == kNotFound ? end() : iterator(ctrl_ + idx, slots_ + idx);
+  }
+  template <typename K>
+  const_iterator find(const K& key) const {
+    return const_cast<FlatHashMap*>(this)->find(key);
+  }
+
+  template <typename K>
+  size_t count(const K& key) const {
+    return Find(key, hash_(key)) == kNotFound ? 0 : 1;
+  }
+  template <typename K>
+  bool contains(const K& key) const {
+    return count(key) != 0;
+  }
+
+  template <typename K>
+  Value& at(const K& key) {
+    size_t idx = Find(key, hash_(key));
+    if (idx == kNotFound) throw std::out_of_range("FlatHashMap::at");
+    return slots_[idx].second;
+  }
+  template <typename K>
+  const Value& at(const K& key) const {
+    return const_cast<FlatHashMap*>(this)->at(key);
+  }
+
+  Value& operator[](const Key& key) { return try_emplace(key).first->second; }
+  Value& operator[](Key&& key) { return try_emplace(std::move(key)).first->second; }
+
+  template <typename K, typename... Args>
+  std::pair<iterator, bool> try_emplace(K&& key, Args&&... args) {
+    size_t hash = hash_(key);
+    size_t idx = Find(key, hash);
+    if (idx != kNotFound) return {iterator(ctrl_ + idx, slots_ + idx), false};
+    idx = PrepareInsert(hash);
+    new (slots_ + idx) slot_type(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+                                 std::forward_as_tuple(std::forward<Args>(args)...));
+    return {iterator(ctrl_ + idx, slots_ + idx), true};
+  }
+
+  template <typename K, typename V>
+  std::pair<iterator, bool> emplace(K&& key, V&& value) {
+    return try_emplace(std::forward<K>(key), std::forward<V>(value));
+  }
+
+  std::pair<iterator, bool> insert(const value_type& value) { return try_emplace(value.first, value.second); }
+  std::pair<iterator, bool> insert(value_type&& value) {
+    return try_emplace(value.first, std::move(value.second));
+  }
+  template <typename K, typename V>
+  std::pair<iterator, bool> insert(std::pair<K, V>&& value) {
+    return try_emplace(std::move(value.first), std::move(value.second));
+  }
+
+  template <typename K, typename V>
+  std::pair<iterator, bool> insert_or_assign(K&& key, V&& value) {
+    auto ret = try_emplace(std::forward<K>(key), std::forward<V>(value));
+    if (!ret.second) ret.first->second = std::forward<V>(value);
+    return ret;
+  }
+
+  template <typename K, typename = typename std::enable_if<!std::is_convertible<K, const_iterator>::value>::type>
+  size_t erase(const K& key) {
+    size_t idx = Find(key, hash_(key));
+    if (idx == kNotFound) return 0;
+    EraseAt(idx);
+    return 1;
+  }
+
+  void erase(const_iterator pos) { EraseAt(static_cast<size_t>(pos.ctrl_ - ctrl_)); }
+
+  void swap(FlatHashMap& other) noexcept { Swap(other); }
+
+ private:
+  using Group = detail::Group;
+  using ctrl_t = detail::ctrl_t;
+  static constexpr size_t kNotFound = static_cast<size_t>(-1);
+
+  static ctrl_t H2(size_t hash) { return static_cast<ctrl_t>(hash & 0x7F); }
+  static size_t H1(size_t hash) { return hash >> 7; }
+
+  // group-aligned quadratic probing, visits every group once since the group number is a power of 2
+  class ProbeSeq {
+   public:
+    ProbeSeq(size_t hash, size_t group_mask) : mask_(group_mask), group_(H1(hash) & group_mask) {}
+    size_t Offset() const { return group_ * Group::kWidth; }
+    void Next() {
+      ++step_;
+      group_ = (group_ + step_) & mask_;
+    }
+
+   private:
+    size_t mask_;
+    size_t group_;
+    size_t step_ = 0;
+  };
+
+  size_t GroupMask() const { return capacity_ / Group::kWidth - 1; }
+
+  template <typename K>
+  size_t Find(const K& key, size_t hash) const {
+    if (size_ == 0) return kNotFound;
+    const ctrl_t h2 = H2(hash);
+    for (ProbeSeq seq(hash, GroupMask());; seq.Next()) {
+      Group g(ctrl_ + seq.Offset());
+      for (auto m = g.Match(h2); m; m.ClearLowest()) {
+        size_t idx = seq.Offset() + m.LowestBit();
+        if (eq_(slots_[idx].first, key)) return idx;
+      }
+      // a group with an empty slot ends every probe sequence passing through it
+      if (g.MatchEmpty()) return kNotFound;
+    }
+  }
+
+  // first free slot of the probe sequence, no duplicate check
+  size_t FindFree(size_t hash) const {
+    for (ProbeSeq seq(hash, GroupMask());; seq.Next()) {
+      auto m = Group(ctrl_ + seq.Offset()).MatchEmptyOrDeleted();
+      if (m) return seq.Offset() + m.LowestBit();
+    }
+  }
+
+  size_t PrepareInsert(size_t hash) {
+    if (size_ + deleted_ + 1 > capacity_ * 7 / 8) {
+      // mostly tombstones, clean them up in place instead of growing
+      Resize(capacity_ && size_ + 1 <= capacity_ * 7 / 16 ? capacity_ : std::max(capacity_ * 2, Group::kWidth));
+    }
+    size_t idx = FindFree(hash);
+    if (ctrl_[idx] == detail::kCtrlDeleted) --deleted_;
+    ctrl_[idx] = H2(hash);
+    ++size_;
+    return idx;
+  }
+
+  void EraseAt(size_t idx) {
+    slots_[idx].~slot_type();
+    --size_;
+    // if the group still has an empty slot no probe went past it, so this one can become empty as well
+    size_t group_start = idx & ~(Group::kWidth - 1);
+    if (Group(ctrl_ + group_start).MatchEmpty()) {
+      ctrl_[idx] = detail::kCtrlEmpty;
+    } else {
+      ctrl_[idx] = detail::kCtrlDeleted;
+      ++deleted_;
+    }
+  }
+
+  template <typename K, typename V>
+  void EmplaceNew(K&& key, V&& value) {
+    size_t hash = hash_(key);
+    size_t idx = PrepareInsert(hash);
+    new (slots_ + idx) slot_type(std::forward<K>(key), std::forward<V>(value));
+  }
+
+  void Resize(size_t new_capacity) {
+    ctrl_t* old_ctrl = ctrl_;
+    slot_type* old_slots = slots_;
+    size_t old_capacity = capacity_;
+
+    // control bytes are loaded a group at a time with aligned loads, plus one sentinel byte
+    ctrl_ = static_cast<ctrl_t*>(::operator new(new_capacity + Group::kWidth, std::align_val_t(Group::kWidth)));
+    slots_ = static_cast<slot_type*>(::operator new(new_capacity * sizeof(slot_type),
+                                                    std::align_val_t(alignof(slot_type))));
+    capacity_ = new_capacity;
+    deleted_ = 0;
+    ResetCtrl();
+
+    for (size_t i = 0; i < old_capacity; ++i) {
+      if (!detail::IsFull(old_ctrl[i])) continue;
+      size_t hash = hash_(old_slots[i].first);
+      size_t idx = FindFree(hash);
+      ctrl_[idx] = H2(hash);
+      new (slots_ + idx) slot_type(std::move(old_slots[i]));
+      old_slots[i].~slot_type();
+    }
+    if (old_capacity) {
+      ::operator delete(old_ctrl, std::align_val_t(Group::kWidth));
+      ::operator delete(old_slots, std::align_val_t(alignof(slot_type)));
+    }
+  }
+
+  void ResetCtrl() {
+    std::memset(ctrl_, static_cast<uint8_t>(detail::kCtrlEmpty), capacity_);
+    ctrl_[capacity_] = detail::kCtrlSentinel;
+  }
+
+  void DestroySlots() {
+    if (std::is_trivially_destructible<slot_type>::value) return;
+    for (size_t i = 0; i < capacity_; ++i) {
+      if (detail::IsFull(ctrl_[i])) slots_[i].~slot_type();
+    }
+  }
+
+  void Release() {
+    if (!capacity_) return;
+    DestroySlots();
+    ::operator delete(ctrl_, std::align_val_t(Group::kWidth));
+    ::operator delete(slots_, std::align_val_t(alignof(slot_type)));
+    ctrl_ = EmptyCtrl();
+    slots_ = nullptr;
+    capacity_ = size_ = deleted_ = 0;
+  }
+
+  void Swap(FlatHashMap& other) noexcept {
+    std::swap(ctrl_, other.ctrl_);
+    std::swap(slots_, other.slots_);
+    std::swap(capacity_, other.capacity_);
+    std::swap(size_, other.size_);
+    std::swap(deleted_, other.deleted_);
+    std::swap(hash_, other.hash_);
+    std::swap(eq_, other.eq_);
+  }
+
+  // begin() == end() on a table without storage
+  static ctrl_t* EmptyCtrl() {
+    static ctrl_t sentinel = detail::kCtrlSentinel;
+    return &sentinel;
+  }
+
+  ctrl_t* ctrl_ = EmptyCtrl();
+  slot_type* slots_ = nullptr;
+  size_t capacity_ = 0;
+  size_t size_ = 0;
+  size_t deleted_ = 0;
+  Hash hash_;
+  Eq eq_;
+};  // FlatHashMap
+
+#endif  // CXXUTIL_FLAT_HASH_MAP_H_
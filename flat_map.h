@@ -0,0 +1,254 @@
+/**
+ * @file flat_map.h
+ *
+ * This file contains a declaration of FlatMap, an ordered map kept as a sorted vector.
+ */
+
+#ifndef CXXUTIL_FLAT_MAP_H_
+#define CXXUTIL_FLAT_MAP_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Ordered map in one contiguous sorted vector of key-value pairs
+ *
+ * Made for small maps that are looked up far more often than modified: no node per element, a lookup touches
+ * log2(n) cache lines of one array and the binary search compiles to conditional moves instead of branches.
+ * Insert and erase shift the tail, O(n), so fill it from a whole range at once where possible.
+ *
+ * With `Eytzinger` set, lookups go through a copy of the keys in breadth-first (Eytzinger) order, where the next
+ * levels of the search are adjacent and can be prefetched. It pays off only for maps well beyond the cache and
+ * costs a second copy of the keys plus an indirection, measure with benchmark_flat_map.h before choosing it.
+ * The copy is rebuilt on every modification, so that mode suits maps built in bulk and then only read.
+ *
+ * Like other flat maps the element type is `std::pair<Key, Value>`, keys must not be modified through iterators.
+ * Iterators are invalidated by insert and erase.
+ */
+template <typename Key, typename Value, typename Compare = std::less<>, bool Eytzinger = false>
+class FlatMap {
+ public:
+  using key_type = Key;
+  using mapped_type = Value;
+  using value_type = std::pair<Key, Value>;
+  using iterator = typename std::vector<value_type>::iterator;
+  using const_iterator = typename std::vector<value_type>::const_iterator;
+
+  FlatMap() = default;
+  explicit FlatMap(const Compare& comp) : comp_(comp) {}
+
+  /**
+   * @brief Bulk construction from unsorted input, O(n log n), the first of equal keys is kept like std::map::insert
+   */
+  explicit FlatMap(std::vector<value_type> items, const Compare& comp = Compare())
+      : items_(std::move(items)), comp_(comp) {
+    SortUnique();
+  }
+  template <typename InputIt>
+  FlatMap(InputIt first, InputIt last, const Compare& comp = Compare()) : items_(first, last), comp_(comp) {
+    SortUnique();
+  }
+  FlatMap(std::initializer_list<value_type> init, const Compare& comp = Compare()) : items_(init), comp_(comp) {
+    SortUnique();
+  }
+
+  iterator begin() noexcept { return items_.begin(); }
+  iterator end() noexcept { return items_.end(); }
+  const_iterator begin() const noexcept { return items_.begin(); }
+  const_iterator end() const noexcept { return items_.end(); }
+  const_iterator cbegin() const noexcept { return items_.begin(); }
+  const_iterator cend() const noexcept { return items_.end(); }
+
+  bool empty() const noexcept { return items_.empty(); }
+  size_t size() const noexcept { return items_.size(); }
+  size_t capacity() const noexcept { return items_.capacity(); }
+
+  void reserve(size_t count) { items_.reserve(count); }
+  void shrink_to_fit() { items_.shrink_to_fit(); }
+
+  void clear() {
+    items_.clear();
+    RebuildIndex();
+  }
+
+  template <typename K>
+  iterator lower_bound(const K& key) {
+    return items_.begin() + LowerBound(key);
+  }
+  template <typename K>
+  const_iterator lower_bound(const K& key) const {
+    return items_.begin() + LowerBound(key);
+  }
+
+  template <typename K>
+  iterator find(const K& key) {
+    size_t idx = Find(key);
+    return idx == kNotFound ? items_.end() : items_.begin() + idx;
+  }
+  template <typename K>
+  const_iterator find(const K& key) const {
+    size_t idx = Find(key);
+    return idx == kNotFound ? items_.end() : items_.begin() + idx;
+  }
+
+  template <typename K>
+  size_t count(const K& key) const {
+    return Find(key) == kNotFound ? 0 : 1;
+  }
+  template <typename K>
+  bool contains(const K& key) const {
+    return Find(key) != kNotFound;
+  }
+
+  template <typename K>
+  Value& at(const K& key) {
+    size_t idx = Find(key);
+    if (idx == kNotFound) throw std::out_of_range("FlatMap::at");
+    return items_[idx].second;
+  }
+  template <typename K>
+  const Value& at(const K& key) const {
+    return const_cast<FlatMap*>(this)->at(key);
+  }
+
+  Value& operator[](const Key& key) { return try_emplace(key).first->second; }
+  Value& operator[](Key&& key) { return try_emplace(std::move(key)).first->second; }
+
+  template <typename K, typename... Args>
+  std::pair<iterator, bool> try_emplace(K&& key, Args&&... args) {
+    size_t idx = LowerBound(key);
+    if (idx != items_.size() && !comp_(key, items_[idx].first)) return {items_.begin() + idx, false};
+    items_.emplace(items_.begin() + idx, std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+                   std::forward_as_tuple(std::forward<Args>(args)...));
+    RebuildIndex();
+    return {items_.begin() + idx, true};
+  }
+
+  std::pair<iterator, bool> insert(const value_type& value) { return try_emplace(value.first, value.second); }
+  std::pair<iterator, bool> insert(value_type&& value) {
+    return try_emplace(std::move(value.first), std::move(value.second));
+  }
+
+  template <typename K, typename V>
+  std::pair<iterator, bool> insert_or_assign(K&& key, V&& value) {
+    auto ret = try_emplace(std::forward<K>(key), std::forward<V>(value));
+    if (!ret.second) ret.first->second = std::forward<V>(value);
+    return ret;
+  }
+
+  template <typename K, typename = typename std::enable_if<!std::is_convertible<K, const_iterator>::value>::type>
+  size_t erase(const K& key) {
+    size_t idx = Find(key);
+    if (idx == kNotFound) return 0;
+    erase(items_.begin() + idx);
+    return 1;
+  }
+
+  iterator erase(const_iterator pos) {
+    iterator it = items_.erase(pos);
+    RebuildIndex();
+    return it;
+  }
+
+  void swap(FlatMap& other) noexcept {
+    using std::swap;
+    swap(items_, other.items_);
+    swap(comp_, other.comp_);
+    swap(index_keys_, other.index_keys_);
+    swap(index_pos_, other.index_pos_);
+  }
+
+ private:
+  static constexpr size_t kNotFound = static_cast<size_t>(-1);
+  // keys in one cache line, the block of descendants 4 levels down is prefetched
+  static constexpr size_t kPrefetchStride = sizeof(Key) >= 64 ? 1 : 64 / sizeof(Key);
+
+  template <typename K>
+  size_t Find(const K& key) const {
+    size_t idx = LowerBound(key);
+    return idx != items_.size() && !comp_(key, items_[idx].first) ? idx : kNotFound;
+  }
+
+  template <typename K>
+  size_t LowerBound(const K& key) const {
+    if (Eytzinger) return EytzingerLowerBound(key);
+    return BranchlessLowerBound(key);
+  }
+
+  // halves the range without a data dependent branch, the compiler emits cmov
+  template <typename K>
+  size_t BranchlessLowerBound(const K& key) const {
+    size_t n = items_.size();
+    if (n == 0) return 0;
+    const value_type* base = items_.data();
+    while (n > 1) {
+      size_t half = n / 2;
+      base = comp_(base[half].first, key) ? base + half : base;
+      n -= half;
+    }
+    return static_cast<size_t>(base - items_.data()) + comp_(base->first, key);
+  }
+
+  // index_keys_[1..n] hold the keys in breadth-first order of the implicit search tree
+  template <typename K>
+  size_t EytzingerLowerBound(const K& key) const {
+    const size_t n = items_.size();
+    const Key* keys = index_keys_.data();
+    size_t k = 1;
+    while (k <= n) {
+      __builtin_prefetch(keys + std::min(k * kPrefetchStride, n));
+      k = 2 * k + comp_(keys[k], key);
+    }
+    // strip the trailing right turns, then the last left turn, what is left is the answer's node
+    k >>= __builtin_ffsll(static_cast<long long>(~k));
+    return k ? index_pos_[k] : n;
+  }
+
+  void SortUnique() {
+    std::stable_sort(items_.begin(), items_.end(),
+                     [this](const value_type& a, const value_type& b) { return comp_(a.first, b.first); });
+    auto last = std::unique(items_.begin(), items_.end(), [this](const value_type& a, const value_type& b) {
+      return !comp_(a.first, b.first) && !comp_(b.first, a.first);
+    });
+    items_.erase(last, items_.end());
+    RebuildIndex();
+  }
+
+  void RebuildIndex() {
+    if (!Eytzinger) return;
+    index_keys_.resize(items_.size() + 1);
+    index_pos_.resize(items_.size() + 1);
+    BuildIndex(0, 1);
+  }
+
+  // in-order walk of the implicit tree hands out sorted positions, returns the next one
+  size_t BuildIndex(size_t i, size_t k) {
+    if (k <= items_.size()) {
+      i = BuildIndex(i, 2 * k);
+      index_keys_[k] = items_[i].first;
+      index_pos_[k] = i++;
+      i = BuildIndex(i, 2 * k + 1);
+    }
+    return i;
+  }
+
+  std::vector<value_type> items_;
+  Compare comp_;
+  // Eytzinger mode only, slot 0 unused
+  std::vector<Key> index_keys_;
+  std::vector<size_t> index_pos_;
+};  // FlatMap
+
+/// FlatMap searched through an Eytzinger index, for large maps built once
+template <typename Key, typename Value, typename Compare = std::less<>>
+using EytzingerFlatMap = FlatMap<Key, Value, Compare, true>;
+
+#endif  // CXXUTIL_FLAT_MAP_H_
@@ -0,0 +1,78 @@
+/**
+ * @file futex.h
+ *
+ * This file contains thin wrappers of futex wait/wake on a 32-bit atomic word.
+ * On platforms without futex, waiting degrades to yielding the cpu.
+ */
+
+#ifndef CXXUTIL_FUTEX_H_
+#define CXXUTIL_FUTEX_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <ctime>
+#endif
+
+namespace detail {
+template <typename T>
+inline int* FutexAddress(std::atomic<T>* addr) {
+  static_assert(sizeof(std::atomic<T>) == sizeof(int), "futex works on 32-bit words only");
+  return reinterpret_cast<int*>(addr);
+}
+}  // namespace detail
+
+/**
+ * @brief Block the calling thread while *addr == expected, may return spuriously
+ */
+template <typename T>
+inline void FutexWait(std::atomic<T>* addr, T expected) {
+#ifdef __linux__
+  syscall(SYS_futex, detail::FutexAddress(addr), FUTEX_WAIT_PRIVATE, static_cast<int>(expected), nullptr, nullptr, 0);
+#else
+  if (addr->load(std::memory_order_relaxed) == expected) std::this_thread::yield();
+#endif
+}
+
+/**
+ * @brief Block the calling thread while *addr == expected, at most for timeout
+ * @return false if timeout expired
+ */
+template <typename T>
+inline bool FutexWaitFor(std::atomic<T>* addr, T expected, std::chrono::nanoseconds timeout) {
+#ifdef __linux__
+  if (timeout.count() <= 0) return false;
+  struct timespec ts;
+  ts.tv_sec = static_cast<time_t>(timeout.count() / 1000000000);
+  ts.tv_nsec = static_cast<long>(timeout.count() % 1000000000);  // NOLINT
+  long ret = syscall(SYS_futex, detail::FutexAddress(addr), FUTEX_WAIT_PRIVATE,  // NOLINT
+                     static_cast<int>(expected), &ts, nullptr, 0);
+  return !(ret == -1 && errno == ETIMEDOUT);
+#else
+  if (addr->load(std::memory_order_relaxed) == expected) std::this_thread::yield();
+  return true;
+#endif
+}
+
+/**
+ * @brief Wake up at most count threads waiting on addr
+ */
+template <typename T>
+inline void FutexWake(std::atomic<T>* addr, int count) {
+#ifdef __linux__
+  syscall(SYS_futex, detail::FutexAddress(addr), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+#else
+  (void)addr;
+  (void)count;
+#endif
+}
+
+#endif  // CXXUTIL_FUTEX_H_
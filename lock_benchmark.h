@@ -1,228 +1,345 @@
-#include <future>
-#include <iostream>
+#include <benchmark/benchmark.h>
+#include <pthread.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <mutex>
+#include <thread>
+#include <vector>
 
+#include "adaptive_mutex.h"
 #include "rwlock.h"
 #include "rw_mutex.h"
+#include "seqlock.h"
+#include "big_reader_mutex.h"
+#include "lock_profiler.h"
+#include "queue_lock.h"
+#include "rcu.h"
 #include "spinlock.h"
 using Clock = std::chrono::steady_clock;
 using Duration = std::chrono::duration<double, std::milli>;
 using TimePoint = std::chrono::time_point<Clock, Duration>;
-void TestRwlock() {
-  TimePoint start, mid, end;
-  Duration dura;
-
-  constexpr int test_time = 100000;
-  int t = 0;
-  int factor = 1;
-
-  std::cout << "--------------------------------------------------\n";
-  RwLock pthread_rw_mutex;
-  t = test_time;
-  start = Clock::now();
-  while (t--) {
-    RwLockReadGuard lk(pthread_rw_mutex);
-  }
-  end = Clock::now();
-  dura = end - start;
-  std::cout << "pthread read " << test_time << " times: " << dura.count() << "ms\n";
-t = test_time;
-  start = Clock::now();
-  while (t--) {
-    RwLockWriteGuard lk(pthread_rw_mutex);
-  }
-  end = Clock::now();
-  dura = end - start;
-  std::cout << "pthread write " << test_time << " times: " << dura.count() << "ms\n";
-
-  std::future<double> ret;
-  t = test_time;
-  start = Clock::now();
-  auto read_process = [&pthread_rw_mutex, test_time, factor]() -> double {
-    int t = factor * test_time;
-    TimePoint s = Clock::now();
-    while (t--) {
-      RwLockReadGuard lk(pthread_rw_mutex);
-    }
-    TimePoint e = Clock::now();
-    return (e - s).count();
-  };
-  ret = std::async(std::launch::async, read_process);
-  auto ret2 = std::async(std::launch::async, read_process);
-  while (t--) {
-    RwLockWriteGuard lk(pthread_rw_mutex);
+
+// pthread_spinlock_t with SpinLock interface
+class PthreadSpinLock {
+ public:
+  PthreadSpinLock() { pthread_spin_init(&lock_, PTHREAD_PROCESS_PRIVATE); }
+  ~PthreadSpinLock() { pthread_spin_destroy(&lock_); }
+  void Lock() { pthread_spin_lock(&lock_); }
+  void Unlock() { pthread_spin_unlock(&lock_); }
+
+ private:
+  PthreadSpinLock(const PthreadSpinLock&) = delete;
+  PthreadSpinLock& operator=(const PthreadSpinLock&) = delete;
+
+  pthread_spinlock_t lock_;
+};
+
+// ProfiledLock declared at one site, default constructible like the locks it wraps
+template <typename Lock>
+class BenchProfiledLock : public ProfiledLock<Lock> {
+ public:
+  BenchProfiledLock() : ProfiledLock<Lock>(__FILE__, __LINE__) {}
+};
+
+// adapters giving every lock a read / write interface, exclusive locks take the same lock for both
+template <typename Lock>
+struct ExclusiveLockAdapter {
+  static void ReadLock(Lock& lock) { lock.Lock(); }
+  static void ReadUnlock(Lock& lock) { lock.Unlock(); }
+  static void WriteLock(Lock& lock) { lock.Lock(); }
+  static void WriteUnlock(Lock& lock) { lock.Unlock(); }
+};
+
+template <typename Mutex>
+struct SharedMutexAdapter {
+  static void ReadLock(Mutex& mutex) { mutex.ReadLock(); }
+  static void ReadUnlock(Mutex& mutex) { mutex.ReadUnlock(); }
+  static void WriteLock(Mutex& mutex) { mutex.WriteLock(); }
+  static void WriteUnlock(Mutex& mutex) { mutex.WriteUnlock(); }
+};
+
+template <typename Lock>
+struct LockAdapter : ExclusiveLockAdapter<Lock> {};
+template <>
+struct LockAdapter<RwMutex> : SharedMutexAdapter<RwMutex> {};
+template <>
+struct LockAdapter<BigReaderRwMutex> : SharedMutexAdapter<BigReaderRwMutex> {};
+template <>
+struct LockAdapter<RwLock> {
+  static void ReadLock(RwLock& lock) { lock.ReadLock(); }
+  static void ReadUnlock(RwLock& lock) { lock.Unlock(); }
+  static void WriteLock(RwLock& lock) { lock.WriteLock(); }
+  static void WriteUnlock(RwLock& lock) { lock.Unlock(); }
+};
+template <>
+struct LockAdapter<std::mutex> {
+  static void ReadLock(std::mutex& lock) { lock.lock(); }
+  static void ReadUnlock(std::mutex& lock) { lock.unlock(); }
+  static void WriteLock(std::mutex& lock) { lock.lock(); }
+  static void WriteUnlock(std::mutex& lock) { lock.unlock(); }
+};
+
+// log-linear histogram of acquire latency, 8 sub-buckets per power of 2 keep the error within 12.5%
+// one per benchmark thread, not thread safe
+struct alignas(kCacheLineSize) AcquireLatency {
+  static constexpr int kSubBucketBits = 3;
+  static constexpr int kSubBucketNum = 1 << kSubBucketBits;
+  static constexpr int kBucketNum = 2 * kSubBucketNum + (40 - kSubBucketBits - 1) * kSubBucketNum;
+
+  static int Index(uint64_t ns) {
+    if (ns < 2 * kSubBucketNum) return static_cast<int>(ns);
+    int exp = 63 - __builtin_clzll(ns);
+    int sub = static_cast<int>((ns >> (exp - kSubBucketBits)) & (kSubBucketNum - 1));
+    int idx = (exp - kSubBucketBits + 1) * kSubBucketNum + sub;
+    return idx < kBucketNum ? idx : kBucketNum - 1;
   }
-  mid = Clock::now();
-  double read_tmp = ret.get();
-  ret2.get();
-  end = Clock::now();
-  dura = end - start;
-  std::cout << "pthread read " << factor * test_time << " times, "
-            << "write " << test_time << ": " << dura.count() << "ms\n";
-  std::cout << "\tpthread write " << test_time << " times: " << (mid - start).count() << "ms\n";
-  std::cout << "\tpthread read " << test_time << " times: " << read_tmp << "ms\n";
-
-  std::cout << "--------------------------------------------------\n";
-  RwMutex rw_mutex;
-  t = test_time;
-  start = Clock::now();
-  while (t--) {
-    UniqueReadLock lk(rw_mutex);
+
+  // smallest value falling into bucket idx
+  static uint64_t Value(int idx) {
+    if (idx < 2 * kSubBucketNum) return static_cast<uint64_t>(idx);
+    int exp = idx / kSubBucketNum + kSubBucketBits - 1;
+    return (uint64_t(kSubBucketNum) + idx % kSubBucketNum) << (exp - kSubBucketBits);
   }
-  end = Clock::now();
-  dura = end - start;
-  std::cout << "read " << test_time << " times: " << dura.count() << "ms\n";
-
-  t = test_time;
-  start = Clock::now();
-  while (t--) {
-    UniqueWriteLock lk(rw_mutex);
+
+  void Record(uint64_t ns) { ++buckets[Index(ns)]; }
+
+  void Merge(const AcquireLatency& other) {
+    for (int i = 0; i < kBucketNum; ++i) buckets[i] += other.buckets[i];
   }
-  end = Clock::now();
-  dura = end - start;
-  std::cout << "write " << test_time << " times: " << dura.count() << "ms\n";
-
-  t = test_time;
-  start = Clock::now();
-  auto read_process2 = [&rw_mutex, test_time, factor]() -> double {
-    int t = factor * test_time;
-    TimePoint s = Clock::now();
-    while (t--) {
-      UniqueReadLock lk(rw_mutex);
+
+  uint64_t Percentile(double p) const {
+    uint64_t count = 0;
+    for (auto b : buckets) count += b;
+    if (count == 0) return 0;
+    const uint64_t rank = static_cast<uint64_t>(p * (count - 1)) + 1;
+    uint64_t acc = 0;
+    for (int i = 0; i < kBucketNum; ++i) {
+      acc += buckets[i];
+      if (acc >= rank) return Value(i);
     }
-    TimePoint e = Clock::now();
-    return (e - s).count();
-  };
-  ret = std::async(std::launch::async, read_process2);
-  ret2 = std::async(std::launch::async, read_process2);
-  while (t--) {
-    UniqueWriteLock lk(rw_mutex);
+    return Value(kBucketNum - 1);
   }
-  mid = Clock::now();
-  read_tmp = ret.get();
-  ret2.get();
-  end = Clock::now();
-  dura = end - start;
-  std::cout << "read " << factor * test_time << " times, "
-            << "write " << test_time << ": " << dura.count() << "ms\n";
-  std::cout << "\twrite " << test_time << " times: " << (mid - start).count() << "ms\n";
-  std::cout << "\tread " << test_time << " times: " << read_tmp << "ms\n";
-
-  std::cout << "--------------------------------------------------\n";
-  std::mutex mut;
-  t = test_time;
-  start = Clock::now();
-  while (t--) {
-    std::lock_guard<std::mutex> lk(mut);
-  }
-  end = Clock::now();
-  dura = end - start;
-  std::cout << "std::mutex lock " << test_time << " times: " << dura.count() << "ms\n";
-
-  t = test_time;
-  start = Clock::now();
-  auto read_process3 = [&mut, test_time, factor]() -> double {
-    int t = factor * test_time;
-    TimePoint s = Clock::now();
-    while (t--) {
-      std::lock_guard<std::mutex> lk(mut);
+
+  uint64_t buckets[kBucketNum] = {};
+};
+
+/**
+ * Lock benchmark, threads take the lock in a loop.
+ *
+ * range(0): percentage of write acquisitions, range(1): critical section length in spin iterations.
+ * Every kLatencySampleInterval-th acquisition is timed, so clock reads barely show in the throughput.
+ * Each thread fills its own histogram, thread 0 merges them after the loop, when the others have stopped.
+ */
+template <typename Lock>
+static void bench_lock(benchmark::State& state) {
+  constexpr uint32_t kLatencySampleInterval = 8;
+  static Lock lock;
+  static std::vector<AcquireLatency> latencies;
+  if (state.thread_index() == 0) latencies.assign(state.threads(), AcquireLatency{});
+
+  const uint32_t write_percent = static_cast<uint32_t>(state.range(0));
+  const int64_t cs_len = state.range(1);
+  // xorshift, differently seeded per thread
+  uint32_t rng = 2463534242u + 977u * static_cast<uint32_t>(state.thread_index());
+  uint32_t n = 0;
+  int64_t cs_work = 0;
+  for (auto _ : state) {
+    AcquireLatency& latency = latencies[state.thread_index()];
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    const bool write = rng % 100 < write_percent;
+    const bool timed = ++n % kLatencySampleInterval == 0;
+    Clock::time_point start;
+    if (timed) start = Clock::now();
+    if (write) {
+      LockAdapter<Lock>::WriteLock(lock);
+    } else {
+      LockAdapter<Lock>::ReadLock(lock);
+    }
+    if (timed) latency.Record(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    for (int64_t i = 0; i < cs_len; ++i) benchmark::DoNotOptimize(++cs_work);
+    if (write) {
+      LockAdapter<Lock>::WriteUnlock(lock);
+    } else {
+      LockAdapter<Lock>::ReadUnlock(lock);
     }
-    TimePoint e = Clock::now();
-    return (e - s).count();
-  };
-  ret = std::async(std::launch::async, read_process3);
-  ret2 = std::async(std::launch::async, read_process3);
-  while (t--) {
-    std::lock_guard<std::mutex> lk(mut);
   }
-  mid = Clock::now();
-  read_tmp = ret.get();
-  ret2.get();
-  end = Clock::now();
-  dura = end - start;
-  std::cout << "one thread lock " << factor * test_time << " times, "
-            << "another thread lock " << test_time << ": " << dura.count() << "ms\n";
-  std::cout << "\twrite " << test_time << " times: " << (mid - start).count() << "ms\n";
-  std::cout << "\tread " << test_time << " times: " << read_tmp << "ms\n";
-
-
-  std::cout << "--------------------------------------------------\n";
-  SpinLock sp_lk;
-  t = test_time;
-  start = Clock::now();
-  while (t--) {
-    SpinLockGuard lk(sp_lk);
+  state.SetItemsProcessed(state.iterations());
+
+  if (state.thread_index() == 0) {
+    AcquireLatency total;
+    for (auto& l : latencies) total.Merge(l);
+    // counters are summed over threads, only thread 0 reports
+    state.counters["p50_ns"] = static_cast<double>(total.Percentile(0.5));
+    state.counters["p99_ns"] = static_cast<double>(total.Percentile(0.99));
+    state.counters["p999_ns"] = static_cast<double>(total.Percentile(0.999));
   }
-  end = Clock::now();
-  dura = end - start;
-  std::cout << "spin lock " << test_time << " times: " << dura.count() << "ms\n";
-
-  t = test_time;
-  start = Clock::now();
-  auto read_process4 = [&sp_lk, test_time, factor]() -> double {
-    int t = factor * test_time;
-    TimePoint s = Clock::now();
-    while (t--) {
-      SpinLockGuard lk(sp_lk);
-    }
-    TimePoint e = Clock::now();
-    return (e - s).count();
-  };
-  ret = std::async(std::launch::async, read_process4);
-  ret2 = std::async(std::launch::async, read_process4);
-  while (t--) {
-    SpinLockGuard lk(sp_lk);
+}
+
+static void LockBenchmarkArgs(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"write%", "cs"});
+  b->ArgsProduct({{0, 10, 50, 100}, {0, 16, 256}});
+  b->ThreadRange(1, 2 * std::max(1, static_cast<int>(std::thread::hardware_concurrency())));
+  b->UseRealTime();
+}
+
+BENCHMARK_TEMPLATE(bench_lock, RwLock)->Apply(LockBenchmarkArgs);
+BENCHMARK_TEMPLATE(bench_lock, RwMutex)->Apply(LockBenchmarkArgs);
+BENCHMARK_TEMPLATE(bench_lock, BigReaderRwMutex)->Apply(LockBenchmarkArgs);
+BENCHMARK_TEMPLATE(bench_lock, SpinLock)->Apply(LockBenchmarkArgs);
+// backoff policies of SpinLock
+BENCHMARK_TEMPLATE(bench_lock, BasicSpinLock<NoBackoff>)->Apply(LockBenchmarkArgs);
+BENCHMARK_TEMPLATE(bench_lock, BasicSpinLock<PauseBackoff>)->Apply(LockBenchmarkArgs);
+BENCHMARK_TEMPLATE(bench_lock, BasicSpinLock<ExponentialBackoff>)->Apply(LockBenchmarkArgs);
+BENCHMARK_TEMPLATE(bench_lock, BasicSpinLock<YieldBackoff>)->Apply(LockBenchmarkArgs);
+BENCHMARK_TEMPLATE(bench_lock, BasicSpinLock<ParkBackoff>)->Apply(LockBenchmarkArgs);
+BENCHMARK_TEMPLATE(bench_lock, TicketLock)->Apply(LockBenchmarkArgs);
+BENCHMARK_TEMPLATE(bench_lock, McsLock)->Apply(LockBenchmarkArgs);
+BENCHMARK_TEMPLATE(bench_lock, AdaptiveMutex)->Apply(LockBenchmarkArgs);
+BENCHMARK_TEMPLATE(bench_lock, std::mutex)->Apply(LockBenchmarkArgs);
+BENCHMARK_TEMPLATE(bench_lock, PthreadSpinLock)->Apply(LockBenchmarkArgs);
+// cost of profiling, compared with SpinLock above
+BENCHMARK_TEMPLATE(bench_lock, BenchProfiledLock<SpinLock>)->Apply(LockBenchmarkArgs);
+
+// small snapshot read by many threads while one thread keeps rewriting it
+struct SnapshotBox {
+  float x, y, w, h;
+  int64_t frame_id;
+};
+
+// snapshot stores with a common Read / Write interface
+struct SeqLockSnapshot {
+  SnapshotBox Read() const { return seq_lock.Read(); }
+  void Write(const SnapshotBox& box) { seq_lock.Write(box); }
+
+  SeqLock<SnapshotBox> seq_lock;
+};
+
+// readers copy under an RCU read-side section, every write waits for a grace period
+struct RcuSnapshot {
+  SnapshotBox Read() const { return *cell.Read(); }
+  void Write(const SnapshotBox& box) { cell.Store(box); }
+
+  RcuCell<SnapshotBox> cell{std::in_place, SnapshotBox{}};
+};
+
+template <typename Lock>
+struct LockedSnapshot {
+  SnapshotBox Read() {
+    LockAdapter<Lock>::ReadLock(lock);
+    SnapshotBox copy = box;
+    LockAdapter<Lock>::ReadUnlock(lock);
+    return copy;
+  }
+  void Write(const SnapshotBox& value) {
+    LockAdapter<Lock>::WriteLock(lock);
+    box = value;
+    LockAdapter<Lock>::WriteUnlock(lock);
   }
-  mid = Clock::now();
-  read_tmp = ret.get();
-  ret2.get();
-  end = Clock::now();
-  dura = end - start;
-  std::cout << "one thread spinlock " << factor * test_time << " times, "
-            << "another thread spinlock " << test_time << ": " << dura.count() << "ms\n";
-  std::cout << "\twrite " << test_time << " times: " << (mid - start).count() << "ms\n";
-  std::cout << "\tread " << test_time << " times: " << read_tmp << "ms\n";
-
-
-  std::cout << "--------------------------------------------------\n";
-  pthread_spinlock_t pthread_sp_lk;
-  pthread_spin_init(&pthread_sp_lk, PTHREAD_PROCESS_PRIVATE);
-  t = test_time;
-  start = Clock::now();
-  while (t--) {
-    pthread_spin_lock(&pthread_sp_lk);
-    pthread_spin_unlock(&pthread_sp_lk);
+
+  Lock lock;
+  SnapshotBox box{};
+};
+
+// rewrites the snapshot in a loop on its own thread, yielding between writes, until destroyed
+template <typename Store>
+class SnapshotWriter {
+ public:
+  explicit SnapshotWriter(Store& store)
+      : thread_([this, &store]() {
+          int64_t frame_id = 0;
+          while (!stop_.load(std::memory_order_relaxed)) {
+            store.Write(SnapshotBox{1.f, 2.f, 3.f, 4.f, ++frame_id});
+            std::this_thread::yield();
+          }
+        }) {}
+  ~SnapshotWriter() {
+    stop_.store(true, std::memory_order_relaxed);
+    thread_.join();
   }
-  end = Clock::now();
-  dura = end - start;
-  std::cout << "pthread spin lock " << test_time << " times: " << dura.count() << "ms\n";
-
-  t = test_time;
-  start = Clock::now();
-  auto read_process5 = [&pthread_sp_lk, test_time, factor]() -> double {
-    int t = factor * test_time;
-    TimePoint s = Clock::now();
-    while (t--) {
-      pthread_spin_lock(&pthread_sp_lk);
-      pthread_spin_unlock(&pthread_sp_lk);
+
+ private:
+  std::atomic<bool> stop_{false};
+  std::thread thread_;
+};
+
+/**
+ * Snapshot read benchmark, threads copy a small struct out of Store.
+ *
+ * range(0): 1 to run a writer thread rewriting the snapshot meanwhile, 0 for reads only.
+ * Thread 0 starts the writer before the loop and stops it after, the loop start and end wait for every thread.
+ */
+template <typename Store>
+static void bench_snapshot_read(benchmark::State& state) {
+  static Store store;
+  static std::unique_ptr<SnapshotWriter<Store>> writer;
+  if (state.thread_index() == 0 && state.range(0)) writer.reset(new SnapshotWriter<Store>(store));
+
+  int64_t sum = 0;
+  for (auto _ : state) sum += store.Read().frame_id;
+  benchmark::DoNotOptimize(sum);
+  state.SetItemsProcessed(state.iterations());
+
+  if (state.thread_index() == 0) writer.reset();
+}
+
+static void SnapshotBenchmarkArgs(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"writer"});
+  b->Arg(0)->Arg(1);
+  b->ThreadRange(1, 2 * std::max(1, static_cast<int>(std::thread::hardware_concurrency())));
+  b->UseRealTime();
+}
+
+BENCHMARK_TEMPLATE(bench_snapshot_read, SeqLockSnapshot)->Apply(SnapshotBenchmarkArgs);
+BENCHMARK_TEMPLATE(bench_snapshot_read, LockedSnapshot<SpinLock>)->Apply(SnapshotBenchmarkArgs);
+BENCHMARK_TEMPLATE(bench_snapshot_read, LockedSnapshot<RwMutex>)->Apply(SnapshotBenchmarkArgs);
+// read-mostly RcuCell, compared with the SeqLock and RwMutex snapshots above
+BENCHMARK_TEMPLATE(bench_snapshot_read, RcuSnapshot)->Apply(SnapshotBenchmarkArgs);
+
+// busy work of about `ns` nanoseconds inside the critical section
+inline void HoldFor(int64_t ns) {
+  if (ns <= 0) return;
+  TimePoint end = Clock::now() + std::chrono::nanoseconds(ns);
+  while (Clock::now() < end) CpuRelax();
+}
+
+/**
+ * Long critical section benchmark, threads take the lock exclusively and hold it for about range(0) ns.
+ *
+ * range(1): every range(1)-th hold sleeps 100us instead, like a critical section doing I/O, 0 for none.
+ * Holds past AdaptiveMutex::kParkThresholdNs make it park rather than spin, the process cpu time shows the cost of
+ * spinning through them.
+ */
+template <typename Lock>
+static void bench_lock_hold(benchmark::State& state) {
+  static Lock lock;
+  const int64_t hold_ns = state.range(0);
+  const int64_t io_every = state.range(1);
+  int64_t n = 0;
+  for (auto _ : state) {
+    LockAdapter<Lock>::WriteLock(lock);
+    if (io_every > 0 && ++n % io_every == 0) {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    } else {
+      HoldFor(hold_ns);
     }
-    TimePoint e = Clock::now();
-    return (e - s).count();
-  };
-  ret = std::async(std::launch::async, read_process5);
-  ret2 = std::async(std::launch::async, read_process5);
-  while (t--) {
-    pthread_spin_lock(&pthread_sp_lk);
-    pthread_spin_unlock(&pthread_sp_lk);
+    LockAdapter<Lock>::WriteUnlock(lock);
   }
-  mid = Clock::now();
-  read_tmp = ret.get();
-  ret2.get();
-  end = Clock::now();
-  dura = end - start;
-  std::cout << "pthread spinlock " << factor * test_time << " times, "
-            << "another pthread spinlock " << test_time << ": " << dura.count() << "ms\n";
-  std::cout << "\twrite " << test_time << " times: " << (mid - start).count() << "ms\n";
-  std::cout << "\tread " << test_time << " times: " << read_tmp << "ms\n";
-  pthread_spin_destroy(&pthread_sp_lk);
+  state.SetItemsProcessed(state.iterations());
 }
+
+static void LockHoldBenchmarkArgs(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"hold_ns", "io_every"});
+  b->ArgsProduct({{300, 5000, 50000}, {0, 100}});
+  b->ThreadRange(1, 2 * std::max(1, static_cast<int>(std::thread::hardware_concurrency())));
+  b->MeasureProcessCPUTime();
+  b->UseRealTime();
+}
+
+BENCHMARK_TEMPLATE(bench_lock_hold, SpinLock)->Apply(LockHoldBenchmarkArgs);
+BENCHMARK_TEMPLATE(bench_lock_hold, std::mutex)->Apply(LockHoldBenchmarkArgs);
+BENCHMARK_TEMPLATE(bench_lock_hold, AdaptiveMutex)->Apply(LockHoldBenchmarkArgs);
@@ -0,0 +1,425 @@
+/**
+ * @file lock_profiler.h
+ *
+ * This file contains ProfiledLock, a wrapper which records contention statistics of any lock in this project
+ * (SpinLock family, RwLock, RwMutex) and std::mutex, and the global registry to dump them.
+ *
+ * Declare locks with PROFILED_LOCK(LockType, name), statistics are collected only if CXXUTIL_LOCK_PROFILING is
+ * defined, otherwise the macro declares the raw lock and costs nothing:
+ *
+ *   PROFILED_LOCK(SpinLock, lock_);
+ *   PROFILED_LOCK(std::mutex, mutex_);
+ *   ...
+ *   BasicSpinLockGuard<decltype(lock_)> lk(lock_);
+ *   PROFILED_LOCK_GUARD(std::lock_guard<decltype(mutex_)>, lk2, mutex_);
+ *   ...
+ *   LockProfileRegistry::Instance().Dump(std::cout);
+ *
+ * The guards of this project (SpinLock, RwLock and RwMutex guards) record the line constructing them as call site.
+ * Guards from elsewhere, e.g. std::lock_guard, do so when declared with PROFILED_LOCK_GUARD.
+ */
+
+#ifndef CXXUTIL_LOCK_PROFILER_H_
+#define CXXUTIL_LOCK_PROFILER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "lock_site.h"
+
+#ifdef CXXUTIL_LOCK_PROFILING
+#define PROFILED_LOCK(LockType, name) ProfiledLock<LockType> name{__FILE__, __LINE__}
+#else
+#define PROFILED_LOCK(LockType, name) LockType name
+#endif
+
+// declares guard `name` of lock and records this line as call site of the acquisition
+#define PROFILED_LOCK_GUARD(GuardType, name, lock) \
+  SetLockSite(lock, __FILE__, __LINE__);           \
+  GuardType name(lock)
+
+/**
+ * @brief Histogram of durations with power-of-two nanosecond buckets, bucket i counts [2^(i-1), 2^i) ns
+ */
+class LatencyHistogram {
+ public:
+  static constexpr int kBucketNum = 40;
+
+  void Record(uint64_t ns) {
+    int idx = ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+    if (idx >= kBucketNum) idx = kBucketNum - 1;
+    buckets_[idx].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  uint64_t Count() const {
+    uint64_t count = 0;
+    for (auto& b : buckets_) count += b.load(std::memory_order_relaxed);
+    return count;
+  }
+
+  /**
+   * @brief Upper bound in ns of the bucket which contains the p-th percentile (p in [0, 1])
+   */
+  uint64_t Percentile(double p) const {
+    const uint64_t count = Count();
+    if (count == 0) return 0;
+    const uint64_t rank = static_cast<uint64_t>(p * (count - 1)) + 1;
+    uint64_t acc = 0;
+    for (int i = 0; i < kBucketNum; ++i) {
+      acc += buckets_[i].load(std::memory_order_relaxed);
+      if (acc >= rank) return uint64_t(1) << i;
+    }
+    return uint64_t(1) << (kBucketNum - 1);
+  }
+
+ private:
+  std::atomic<uint64_t> buckets_[kBucketNum] = {};
+};
+
+/**
+ * @brief Statistics of all locks of one type declared at one source location
+ */
+struct LockStats {
+  static constexpr int kMaxCallSites = 8;
+
+  struct CallSite {
+    std::atomic<const char*> file{nullptr};
+    std::atomic<int> line{0};
+    std::atomic<uint64_t> count{0};
+  };
+
+  LockStats(std::string type, const char* file, int line) : type(std::move(type)), file(file), line(line) {}
+
+  void RecordCallSite(const char* site_file, int site_line) {
+    for (auto& site : call_sites) {
+      const char* f = site.file.load(std::memory_order_acquire);
+      if (f == nullptr) {
+        // claim a free entry, `line` is published before `file`
+        std::lock_guard<std::mutex> lk(site_mutex);
+        if (site.file.load(std::memory_order_relaxed) == nullptr) {
+          site.line.store(site_line, std::memory_order_relaxed);
+          site.file.store(site_file, std::memory_order_release);
+          site.count.fetch_add(1, std::memory_order_relaxed);
+          return;
+        }
+        f = site.file.load(std::memory_order_acquire);
+      }
+      if (f == site_file && site.line.load(std::memory_order_relaxed) == site_line) {
+        site.count.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+    }
+    dropped_call_sites.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  const std::string type;
+  const char* const file;
+  const int line;
+  std::atomic<uint64_t> instances{0};
+  std::atomic<uint64_t> acquisitions{0};
+  std::atomic<uint64_t> contended{0};
+  LatencyHistogram wait_ns;
+  LatencyHistogram hold_ns;
+  CallSite call_sites[kMaxCallSites];
+  std::atomic<uint64_t> dropped_call_sites{0};
+  std::mutex site_mutex;
+};
+
+/**
+ * @brief Global table of lock statistics, keyed by type and declaration site of the lock
+ */
+class LockProfileRegistry {
+ public:
+  static LockProfileRegistry& Instance() {
+    static LockProfileRegistry registry;
+    return registry;
+  }
+
+  std::shared_ptr<LockStats> Register(const std::string& type, const char* file, int line) {
+    std::lock_guard<std::mutex> lk(mutex_);
+    auto& stats = stats_[std::make_tuple(type, std::string(file), line)];
+    if (!stats) stats = std::make_shared<LockStats>(type, file, line);
+    stats->instances.fetch_add(1, std::memory_order_relaxed);
+    return stats;
+  }
+
+  /**
+   * @brief Print statistics of all locks, most contended first
+   */
+  void Dump(std::ostream& os) const {
+    std::vector<std::shared_ptr<LockStats>> all;
+    {
+      std::lock_guard<std::mutex> lk(mutex_);
+      for (auto& it : stats_) all.push_back(it.second);
+    }
+    std::sort(all.begin(), all.end(), [](const std::shared_ptr<LockStats>& lhs, const std::shared_ptr<LockStats>& rhs) {
+      return lhs->contended.load(std::memory_order_relaxed) > rhs->contended.load(std::memory_order_relaxed);
+    });
+
+    os << "--------------------------------------------------\n";
+    for (auto& s : all) {
+      const uint64_t acq = s->acquisitions.load(std::memory_order_relaxed);
+      const uint64_t con = s->contended.load(std::memory_order_relaxed);
+      os << s->type << " at " << s->file << ":" << s->line << " (" << s->instances.load(std::memory_order_relaxed)
+         << " instances)\n";
+      os << "\tacquisitions: " << acq << ", contended: " << con << " ("
+         << (acq ? 100.0 * con / acq : 0.0) << "%)\n";
+      os << "\twait ns p50/p99/p999: <" << s->wait_ns.Percentile(0.5) << " / <" << s->wait_ns.Percentile(0.99)
+         << " / <" << s->wait_ns.Percentile(0.999) << "\n";
+      if (s->hold_ns.Count()) {
+        os << "\thold ns p50/p99/p999: <" << s->hold_ns.Percentile(0.5) << " / <" << s->hold_ns.Percentile(0.99)
+           << " / <" << s->hold_ns.Percentile(0.999) << "\n";
+      }
+      for (auto& site : s->call_sites) {
+        const char* f = site.file.load(std::memory_order_acquire);
+        if (!f) break;
+        os << "\t\tacquired at " << f << ":" << site.line.load(std::memory_order_relaxed) << ": "
+           << site.count.load(std::memory_order_relaxed) << " times\n";
+      }
+      const uint64_t dropped = s->dropped_call_sites.load(std::memory_order_relaxed);
+      if (dropped) os << "\t\tacquired at other sites: " << dropped << " times\n";
+    }
+  }
+
+  void Reset() {
+    std::lock_guard<std::mutex> lk(mutex_);
+    stats_.clear();
+  }
+
+ private:
+  LockProfileRegistry() = default;
+
+  mutable std::mutex mutex_;
+  std::map<std::tuple<std::string, std::string, int>, std::shared_ptr<LockStats>> stats_;
+};
+
+namespace detail {
+template <typename T, typename = void>
+struct HasTryLock : std::false_type {};
+template <typename T>
+struct HasTryLock<T, decltype(void(std::declval<T&>().TryLock()))> : std::true_type {};
+
+template <typename T, typename = void>
+struct HasStdTryLock : std::false_type {};
+template <typename T>
+struct HasStdTryLock<T, decltype(void(std::declval<T&>().try_lock()))> : std::true_type {};
+
+template <typename T, typename = void>
+struct HasTryReadLock : std::false_type {};
+template <typename T>
+struct HasTryReadLock<T, decltype(void(std::declval<T&>().TryReadLock()))> : std::true_type {};
+
+template <typename T, typename = void>
+struct HasTryWriteLock : std::false_type {};
+template <typename T>
+struct HasTryWriteLock<T, decltype(void(std::declval<T&>().TryWriteLock()))> : std::true_type {};
+
+struct LockSite {
+  const char* file;
+  int line;
+};
+
+// set by SetLockSite right before the calling thread acquires a ProfiledLock, consumed by that acquisition
+inline thread_local LockSite pending_lock_site = {nullptr, 0};
+
+template <typename T>
+inline const char* LockTypeName() {
+  // "... [with T = SpinLock]" with gcc and clang
+  return __PRETTY_FUNCTION__;
+}
+}  // namespace detail
+
+/**
+ * @brief Wraps a lock and records acquisitions, contended acquisitions, wait time and hold time
+ *
+ * Provides every locking interface used in this project, only the ones supported by LockType could be called.
+ * An acquisition is contended if the try-lock of LockType fails, or, for locks without try-lock,
+ * if it waits longer than kContendedNs. A successful TryLock is an uncontended acquisition, a failed one is not
+ * counted. Hold time is recorded for exclusive ownership only.
+ *
+ * The declaration site is passed explicitly, see PROFILED_LOCK, so that every lock member of a class gets its own
+ * entry. Call sites come from the guard taking the lock through SetLockSite, acquisitions without one are counted
+ * under kUnknownSite.
+ */
+template <typename LockType>
+class ProfiledLock {
+ public:
+  static constexpr uint64_t kContendedNs = 1000;
+  static constexpr const char* kUnknownSite = "<no guard>";
+
+  template <typename... Params>
+  explicit ProfiledLock(const char* file, int line, Params&&... params)
+      : lock_(std::forward<Params>(params)...),
+        stats_(LockProfileRegistry::Instance().Register(TypeName(), file, line)) {}
+
+  // call site of the next acquisition by this thread
+  void SetSite(const char* file, int line) { detail::pending_lock_site = {file, line}; }
+
+  // SpinLock interface
+  void Lock() {
+    Acquire([this]() { return TryExclusive(); }, [this]() { lock_.Lock(); }, true);
+  }
+  bool TryLock() {
+    return TryAcquire([this]() { return lock_.TryLock(); });
+  }
+  void Unlock() {
+    OnRelease();
+    lock_.Unlock();
+  }
+
+  // std::mutex interface, so std::lock_guard and std::unique_lock work
+  void lock() {
+    Acquire([this]() { return TryExclusive(); }, [this]() { lock_.lock(); }, true);
+  }
+  bool try_lock() {
+    return TryAcquire([this]() { return lock_.try_lock(); });
+  }
+  void unlock() {
+    OnRelease();
+    lock_.unlock();
+  }
+
+  // RwLock and RwMutex interface
+  void ReadLock() {
+    Acquire([this]() { return TryShared(); }, [this]() { lock_.ReadLock(); }, false);
+  }
+  void WriteLock() {
+    Acquire([this]() { return TryWrite(); }, [this]() { lock_.WriteLock(); }, true);
+  }
+  void ReadUnlock() { lock_.ReadUnlock(); }
+  void WriteUnlock() {
+    OnRelease();
+    lock_.WriteUnlock();
+  }
+
+  // counting interface of RwMutex and BigReaderRwMutex, so BasicUniqueReadLock and friends work
+  void ReadLock(size_t* count, size_t* reading) {
+    Acquire([]() { return -1; }, [&]() { lock_.ReadLock(count, reading); }, false);
+  }
+  void ReadUnlock(size_t* count, size_t* reading, bool release = false) { lock_.ReadUnlock(count, reading, release); }
+  void WriteLock(size_t* count) {
+    Acquire([]() { return -1; }, [&]() { lock_.WriteLock(count); }, true);
+  }
+  void WriteUnlock(size_t* count, bool release = false) {
+    if (!count || *count > 0) OnRelease();
+    lock_.WriteUnlock(count, release);
+  }
+  void UpgradeLock(size_t* count) {
+    Acquire([]() { return -1; }, [&]() { lock_.UpgradeLock(count); }, false);
+  }
+  void UpgradeUnlock(size_t* count, bool release = false) { lock_.UpgradeUnlock(count, release); }
+  void Upgrade(size_t* upgrade_count, size_t* write_count) {
+    Acquire([]() { return -1; }, [&]() { lock_.Upgrade(upgrade_count, write_count); }, true);
+  }
+  void Downgrade(size_t* write_count, size_t* read_count, size_t* reading) {
+    if (!write_count || *write_count > 0) OnRelease();
+    lock_.Downgrade(write_count, read_count, reading);
+  }
+  bool Reading() { return lock_.Reading(); }
+  bool Writing() { return lock_.Writing(); }
+  bool Upgrading() { return lock_.Upgrading(); }
+
+  LockType& Raw() { return lock_; }
+  const LockStats& Stats() const { return *stats_; }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  static std::string TypeName() {
+    std::string name = detail::LockTypeName<LockType>();
+    auto pos = name.find("T = ");
+    if (pos == std::string::npos) return name;
+    name = name.substr(pos + 4);
+    return name.substr(0, name.find_first_of(";]"));
+  }
+
+  // return 1 if acquired, 0 if busy, -1 if LockType has no try-lock
+  int TryExclusive() {
+    return TryImpl(detail::HasTryLock<LockType>(), detail::HasStdTryLock<LockType>());
+  }
+  template <typename HasStd>
+  int TryImpl(std::true_type, HasStd) { return lock_.TryLock() ? 1 : 0; }
+  int TryImpl(std::false_type, std::true_type) { return lock_.try_lock() ? 1 : 0; }
+  int TryImpl(std::false_type, std::false_type) { return -1; }
+
+  int TryShared() { return TryReadImpl(detail::HasTryReadLock<LockType>()); }
+  int TryReadImpl(std::true_type) { return lock_.TryReadLock() ? 1 : 0; }
+  int TryReadImpl(std::false_type) { return -1; }
+
+  int TryWrite() { return TryWriteImpl(detail::HasTryWriteLock<LockType>()); }
+  int TryWriteImpl(std::true_type) { return lock_.TryWriteLock() ? 1 : 0; }
+  int TryWriteImpl(std::false_type) { return -1; }
+
+  static detail::LockSite TakeSite() {
+    const detail::LockSite site = detail::pending_lock_site;
+    detail::pending_lock_site = {nullptr, 0};
+    return site;
+  }
+
+  template <typename TryFunc, typename LockFunc>
+  void Acquire(TryFunc&& try_lock, LockFunc&& lock, bool exclusive) {
+    const detail::LockSite site = TakeSite();
+    const auto start = Clock::now();
+    const int tried = try_lock();
+    if (tried != 1) lock();
+    const auto now = Clock::now();
+    const uint64_t wait = std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count();
+    const bool contended = tried == 0 || (tried == -1 && wait > kContendedNs);
+    OnAcquired(site, now, wait, contended, exclusive);
+  }
+
+  // an exclusive try-lock, only a successful one counts as acquisition, without wait
+  template <typename TryFunc>
+  bool TryAcquire(TryFunc&& try_lock) {
+    const detail::LockSite site = TakeSite();
+    if (!try_lock()) return false;
+    OnAcquired(site, Clock::now(), 0, false, true);
+    return true;
+  }
+
+  void OnAcquired(const detail::LockSite& site, Clock::time_point now, uint64_t wait, bool contended,
+                  bool exclusive) {
+    stats_->acquisitions.fetch_add(1, std::memory_order_relaxed);
+    if (contended) stats_->contended.fetch_add(1, std::memory_order_relaxed);
+    stats_->wait_ns.Record(wait);
+    if (site.file) {
+      stats_->RecordCallSite(site.file, site.line);
+    } else {
+      stats_->RecordCallSite(kUnknownSite, 0);
+    }
+    if (exclusive) {
+      hold_start_ = now;
+      exclusive_held_.store(true, std::memory_order_relaxed);
+    }
+  }
+
+  void OnRelease() {
+    // RwLock has one Unlock for both modes, while a writer holds the lock no reader could unlock
+    if (exclusive_held_.load(std::memory_order_relaxed)) {
+      exclusive_held_.store(false, std::memory_order_relaxed);
+      stats_->hold_ns.Record(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - hold_start_).count());
+    }
+  }
+
+  ProfiledLock(const ProfiledLock&) = delete;
+  ProfiledLock& operator=(const ProfiledLock&) = delete;
+
+  LockType lock_;
+  std::shared_ptr<LockStats> stats_;
+  std::atomic<bool> exclusive_held_{false};
+  Clock::time_point hold_start_;
+};  // class ProfiledLock
+
+#endif  // CXXUTIL_LOCK_PROFILER_H_
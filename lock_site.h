@@ -0,0 +1,32 @@
+/**
+ * @file lock_site.h
+ *
+ * This file contains SetLockSite, through which the lock guards of this project tell a lock that records call sites
+ * (ProfiledLock, see lock_profiler.h) where the guard was constructed. For any other lock it compiles to nothing.
+ */
+
+#ifndef CXXUTIL_LOCK_SITE_H_
+#define CXXUTIL_LOCK_SITE_H_
+
+#include <type_traits>
+#include <utility>
+
+namespace detail {
+template <typename T, typename = void>
+struct RecordsLockSite : std::false_type {};
+template <typename T>
+struct RecordsLockSite<T, decltype(void(std::declval<T&>().SetSite(nullptr, 0)))> : std::true_type {};
+}  // namespace detail
+
+/**
+ * @brief Names file:line as the site of the next acquisition of lock by the calling thread
+ *
+ * Guards call it right before locking, with file and line defaulted to __builtin_FILE/__builtin_LINE of their own
+ * constructor, which resolve to the code constructing the guard.
+ */
+template <typename LockType>
+inline void SetLockSite(LockType& lock, const char* file, int line) {
+  if constexpr (detail::RecordsLockSite<LockType>::value) lock.SetSite(file, line);
+}
+
+#endif  // CXXUTIL_LOCK_SITE_H_
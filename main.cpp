@@ -121,87 +121,21 @@ void TestExecutable() {
   if (iret==-1) printf("%d:%s\n",errno,std::strerror(errno));
 }
 
-#include <curl/curl.h>
-#include <sys/stat.h>
-#include <cstdlib>
-
-class CurlDownloader {
- public:
-  explicit CurlDownloader(const std::string& model_dir): model_dir_(model_dir) {
-    if (access(model_dir_.c_str(), W_OK) != 0) {
-      std::cerr << "model directory not exist or do not have write permission: " << model_dir_ << "\n";
-      std::exit(-1);
-    }
-    curl_ = curl_easy_init();
-    curl_easy_setopt(curl_, CURLOPT_NOPROGRESS, false);
-  }
-
-  std::string Download(const std::string& url) {
-    // get name of model file
-    std::string file_path = model_dir_ + url.substr(url.find_last_of('/'));
-
-    if (access(file_path.c_str(), F_OK) == 0) {
-      std::cout << "model exists in specified directory, skip download\n";
-      return file_path;
-    } else {
-      FileHandle f(file_path, "wb");
-      FILE* file = f.GetFile();
-
-      curl_easy_setopt(curl_, CURLOPT_URL, url.c_str());
-      curl_easy_setopt(curl_, CURLOPT_WRITEDATA, file);
-
-      auto re = curl_easy_perform(curl_);
-      if (re != CURLE_OK) {
-        std::cerr << "Download model error, error_code: " << re << "\n";
-        std::cerr << "model url: " << url << "\n";
-        return {};
-      }
-      return file_path;
-    }
-  }
-
-  ~CurlDownloader() {
-    if (curl_) {
-      curl_easy_cleanup(curl_);
-      curl_ = nullptr;
-    }
-  }
-
- private:
-  class FileHandle {
-   public:
-    explicit FileHandle(const std::string& fpath, const char* mode) {
-      file_ = fopen(fpath.c_str(), mode);
-    }
-    FILE* GetFile() {return file_;}
-    ~FileHandle() {
-      fclose(file_);
-    }
-  
-   private:
-    FILE* file_ = nullptr;
-  };  // class FileHandle
-
-  std::string model_dir_;
-  CURL* curl_ = nullptr;
-
-};  // class CurlDownloader
+#include "curl_downloader.h"
+#include "model_cache.h"
+#include "async_downloader.h"
 
 bool BeginWith(const std::string& s, const std::string& prefix) {
   if (s.size() < prefix.size()) return false;
   return prefix == s.substr(0, prefix.size());
 }
 
+#include "perfect_hash.h"
 static inline bool IsNetFile(const std::string& url) {
-  std::vector<std::string> protocols = {"http://", "https://", "ftp://"};
-  bool is_net = false;
-  for (auto& proto : protocols) {
-    if (BeginWith(url, proto)) {
-      is_net = true;
-      break;
-    }
-  }
-  return is_net;
+  // scheme before "://" looked up in a table laid out at compile time
+  static constexpr auto kNetProtocols = MakePerfectHashSet({"http", "https", "ftp"});
+  size_t pos = url.find("://");
+  return pos != std::string::npos && kNetProtocols.contains(std::string_view(url.data(), pos));
 }
 
 void TestCurl() {
@@ -216,6 +150,24 @@ void TestCurl() {
   std::cout << std::boolalpha << IsNetFile(url_wrong) << std::endl;
   /* const char *wrong_url = "https://www.tesgvsad.cn/gawi/gsd.txt"; */
   std::cout << "download file in: " << d.Download(url) << std::endl;
+  const char *url_png = "https://csdnimg.cn/release/blogv2/dist/pc/img/original.png";
+  d.DownloadBatch({url, url_png, url_wrong}, [](const DownloadResult& r) {
+    std::cout << r.url << " -> " << (r.ok() ? r.file_path : r.error) << std::endl;
+  });
+
+  ModelCache cache("./model_cache");
+  d.SetCache(&cache);
+  std::cout << "cached file in: " << d.Download(url) << std::endl;
+  std::cout << "cached file in: " << d.Download(url) << std::endl;
+
+  // both requests share one transfer, the caller goes on meanwhile
+  AsyncDownloader async_d("./");
+  auto f1 = async_d.DownloadAsync(url_png);
+  auto f2 = async_d.DownloadAsync(url_png, [](const DownloadResult& r) {
+    std::cout << "async done: " << (r.ok() ? r.file_path : r.error) << std::endl;
+  });
+  std::cout << "async downloads in flight: " << async_d.GetInflightNum() << std::endl;
+  std::cout << "async file in: " << f1.get().file_path << ", " << f2.get().file_path << std::endl;
   /* std::cout << "download file in: " << d.Download(url) << std::endl; */
   /* std::cout << "download file in: " << d.Download(wrong_url) << std::endl; */
 }
@@ -245,12 +197,26 @@ void TestEmit(int a, const std::string& str) {
 */
 
 #include "temp.h"
+namespace {
+// spelled like the LocalItem of temp.cpp, yet another type
+struct LocalItem {
+  int value;
+};
+}  // namespace
+
 void TestTemp() {
   aContainer a;
   int i_a;
   a.PrintTypeAddress(i_a);
   PrintIntTypeAddress();
 
+  std::cout << "################any from libfoo\n";
+  any foo_item = MakeFooItemAny(3);
+  // libfoo has its own vtable of FooItem, the type signature recognizes it
+  std::cout << "FooItem from libfoo: " << any_cast<FooItem&>(foo_item).name << std::endl;
+  any foo_local = MakeFooLocalAny();
+  std::cout << "libfoo LocalItem taken for ours: " << (any_cast<LocalItem>(&foo_local) != nullptr) << std::endl;
+
   /* TestEmit(2, "some string"); */
 }
 
@@ -439,10 +405,54 @@ class SignalClass {
   Signal<SignalPolicy::SYNC, int, const std::string&> sig_a;
 };
 
+class AsyncSignalClass {
+ signals:
+  AsyncSignal<int> sig_value;
+};
+
+class SlotClass {
+ public:
+  void OnSignal(int a, const std::string& b) {
+    std::cout << "member slot: " << a << " " << b << "\n";
+  }
+};
+
 void TestSigSlot() {
   SignalClass sig_c;
+  SlotClass slot_c;
+  int count = 0;
   connect(&sig_c, sig_a, SlotFunc);
+  connect(&sig_c, sig_a, &slot_c, &SlotClass::OnSignal);
+  connect(&sig_c, sig_a, [&count](int, const std::string&) { ++count; });
   sig_c.EmitSignal(5, "test signal slot");
+  std::cout << "lambda slot called " << count << " times\n";
+
+  std::atomic<int> coalesced{0}, latest{-1}, batches{0}, batched{0}, limited{0}, limited_latest{-1};
+  {
+    AsyncSignalClass async_c;
+    // a burst is delivered in fewer calls, the last one with the latest value
+    connect(&async_c, sig_value, [&](int value) {
+      ++coalesced;
+      latest = value;
+    }, EmitOptions(EmitPolicy::COALESCE));
+    // every value arrives, grouped by what was emitted while the slot was busy
+    connect(&async_c, sig_value, [&](std::vector<std::tuple<int>> values) {
+      ++batches;
+      batched += values.size();
+    }, EmitOptions(EmitPolicy::BATCH));
+    // like COALESCE, a delivery less than 20ms after the previous one waits for the rest of the 20ms
+    connect(&async_c, sig_value, [&](int value) {
+      ++limited;
+      limited_latest = value;
+    }, EmitOptions(EmitPolicy::RATE_LIMIT, std::chrono::milliseconds(20)));
+    for (int i = 0; i < 100; ++i) emit async_c.sig_value(i);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    for (int i = 100; i < 200; ++i) emit async_c.sig_value(i);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+  std::cout << "COALESCE slot called " << coalesced << " times, latest value " << latest << "\n";
+  std::cout << "BATCH slot called " << batches << " times with " << batched << " values\n";
+  std::cout << "RATE_LIMIT slot called " << limited << " times, latest value " << limited_latest << "\n";
 }
 
 class DestructorCatch {
@@ -549,6 +559,27 @@ void TestAnyContainer() {
   /* s = cc.Get<std::string&&>(); */
 }
 
+#include "property_bag.h"
+
+void TestPropertyBag() {
+  PropertySchema schema;
+  const auto kFrameId = schema.Add<int64_t>("frame_id");
+  const auto kExposure = schema.Add<double>("exposure");
+  const auto kCamera = schema.Add<std::string>("camera");
+
+  PropertyBag bag(schema);
+  for (int64_t frame = 0; frame < 2; ++frame) {
+    bag.Reset();
+    bag.Set(kFrameId, frame);
+    bag.Set(kCamera, "front");
+    if (frame) bag.Set(kExposure, 0.5);
+    PropertyBag copy = bag.Clone();
+    std::cout << "frame " << copy.Get(kFrameId) << " camera " << copy.Get(kCamera) << " exposure "
+              << (copy.Find(kExposure) ? std::to_string(*copy.Find(kExposure)) : "none") << " fields " << copy.size()
+              << "\n";
+  }
+}
+
 template <int T>
 struct TraitsBase {
   static constexpr const char* type = "unknown";
@@ -571,6 +602,12 @@ constexpr const char* GetTraitsName(const int i) {
 void TestConstexpr() {
   int a = 1;
   std::cout << GetTraitsName(a) << std::endl;
+  // name to id, the reverse of GetTraitsName, resolved by the compiler for constant keys
+  static constexpr auto kTraitsIds = MakePerfectHashMap<int>({{"unknown", 0}, {"int", 1}, {"float", 2}});
+  static_assert(*kTraitsIds.find("float") == 2, "perfect hash lookup is a constant expression");
+  std::string name = "int";
+  const int* id = kTraitsIds.find(name);
+  std::cout << name << " -> " << (id ? *id : -1) << std::endl;
 }
 
 inline void RealFunc(OneItem item) {
@@ -790,6 +827,7 @@ int main(int argc, char** argv) {
   TestVector();
   /* TestAtomic(); */
   TestAnyContainer();
+  TestPropertyBag();
   TestConstexpr();
   TestInline();
   TestFuture();
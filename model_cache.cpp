@@ -0,0 +1,361 @@
+#include "model_cache.h"
+
+#include <dirent.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "xxhash.h"
+
+namespace {
+
+constexpr char kIndexMagic[] = "model_cache";
+constexpr int kIndexVersion = 1;
+
+std::string ToHex(uint64_t v) {
+  char buf[17];
+  snprintf(buf, sizeof(buf), "%016" PRIx64, v);
+  return buf;
+}
+
+// value of header line `name: value\r\n` if it is that header, name in lower case with the colon
+bool MatchHeader(const char* line, size_t len, const char* name, std::string* value) {
+  const size_t name_len = strlen(name);
+  if (len < name_len || strncasecmp(line, name, name_len) != 0) return false;
+  size_t begin = name_len;
+  size_t end = len;
+  while (begin < end && (line[begin] == ' ' || line[begin] == '\t')) ++begin;
+  while (end > begin && (line[end - 1] == '\r' || line[end - 1] == '\n' || line[end - 1] == ' ')) --end;
+  value->assign(line + begin, end - begin);
+  return true;
+}
+
+}  // namespace
+
+struct ModelCache::Response {
+  std::string etag;
+  std::string last_modified;
+  int64_t length = -1;
+  FILE* file = nullptr;
+  int64_t received = 0;
+  Xxh64 hasher;
+
+  // empty when the server reports nothing to tell versions apart
+  std::string Version() const {
+    if (!etag.empty()) return etag;
+    if (!last_modified.empty()) return last_modified + " " + std::to_string(length);
+    return {};
+  }
+};
+
+ModelCache::ModelCache(const std::string& cache_dir, int64_t max_bytes)
+    : cache_dir_(cache_dir), max_bytes_(max_bytes) {
+  if (mkdir(cache_dir_.c_str(), 0755) != 0 && errno != EEXIST) {
+    std::cerr << "can not create model cache directory: " << cache_dir_ << ": " << std::strerror(errno) << "\n";
+  }
+  curl_ = curl_easy_init();
+  if (LoadIndex()) {
+    RemoveOrphans();
+  } else {
+    // the blobs may be listed by an index of another version, leave them alone
+    std::cerr << "model cache index unreadable, start empty: " << cache_dir_ << "\n";
+  }
+}
+
+ModelCache::~ModelCache() {
+  if (curl_) {
+    curl_easy_cleanup(curl_);
+    curl_ = nullptr;
+  }
+}
+
+std::string ModelCache::MakeKey(const std::string& url, const std::string& version) {
+  Xxh64 hasher;
+  hasher.Update(url.data(), url.size());
+  hasher.Update("\n", 1);
+  hasher.Update(version.data(), version.size());
+  return ToHex(hasher.Digest());
+}
+
+bool ModelCache::LoadIndex() {
+  entries_.clear();
+  total_bytes_ = 0;
+  tick_ = 0;
+  std::ifstream in(cache_dir_ + "/index");
+  if (!in) return true;
+
+  std::string magic;
+  int version = 0;
+  std::string line;
+  if (!(in >> magic >> version >> tick_) || magic != kIndexMagic || version != kIndexVersion) return false;
+  std::getline(in, line);
+  while (std::getline(in, line)) {
+    // key, content hash, size, last use, url, version, tab separated, the version last as it may hold anything
+    std::istringstream fields(line);
+    std::string key;
+    std::string hash;
+    Entry entry;
+    if (!std::getline(fields, key, '\t') || !std::getline(fields, hash, '\t') || !(fields >> entry.size) ||
+        fields.get() != '\t' || !(fields >> entry.last_use) || fields.get() != '\t' ||
+        !std::getline(fields, entry.url, '\t')) {
+      continue;
+    }
+    std::getline(fields, entry.version);
+    entry.content_hash = std::strtoull(hash.c_str(), nullptr, 16);
+    total_bytes_ += entry.size;
+    entries_[key] = std::move(entry);
+  }
+  return true;
+}
+
+bool ModelCache::SaveIndex() const {
+  // replaced by rename, a crash leaves either the old or the new index
+  const std::string path = cache_dir_ + "/index";
+  const std::string tmp_path = path + ".tmp";
+  std::ostringstream out;
+  out << kIndexMagic << " " << kIndexVersion << " " << tick_ << "\n";
+  for (const auto& kv : entries_) {
+    const Entry& e = kv.second;
+    out << kv.first << "\t" << ToHex(e.content_hash) << "\t" << e.size << "\t" << e.last_use << "\t" << e.url
+        << "\t" << e.version << "\n";
+  }
+  const std::string content = out.str();
+  FILE* file = fopen(tmp_path.c_str(), "wb");
+  if (!file) return false;
+  // on disk before the rename, or a crash could leave the new name on an empty file
+  bool written = fwrite(content.data(), 1, content.size(), file) == content.size() && fflush(file) == 0 &&
+                 fsync(fileno(file)) == 0;
+  written = fclose(file) == 0 && written;
+  if (!written) {
+    std::remove(tmp_path.c_str());
+    return false;
+  }
+  return std::rename(tmp_path.c_str(), path.c_str()) == 0;
+}
+
+void ModelCache::RemoveOrphans() {
+  DIR* dir = opendir(cache_dir_.c_str());
+  if (!dir) return;
+  while (dirent* ent = readdir(dir)) {
+    const std::string name = ent->d_name;
+    // downloads and index writes cut short, and blobs published by a process which died before saving the index
+    const bool tmp = name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0;
+    const bool blob = name.size() == 16 && name.find_first_not_of("0123456789abcdef") == std::string::npos;
+    if (tmp || (blob && entries_.find(name) == entries_.end())) std::remove((cache_dir_ + "/" + name).c_str());
+  }
+  closedir(dir);
+}
+
+CURLcode ModelCache::Request(const std::string& url, FILE* file, Response* response, DownloadResult* result) {
+  char error[CURL_ERROR_SIZE] = {};
+  curl_easy_reset(curl_);
+  curl_easy_setopt(curl_, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl_, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(curl_, CURLOPT_FAILONERROR, 1L);
+  curl_easy_setopt(curl_, CURLOPT_ERRORBUFFER, error);
+  curl_easy_setopt(curl_, CURLOPT_HEADERDATA, response);
+  curl_easy_setopt(curl_, CURLOPT_HEADERFUNCTION,
+                   static_cast<curl_write_callback>([](char* line, size_t size, size_t nmemb, void* userdata) {
+                     Response* r = static_cast<Response*>(userdata);
+                     const size_t len = size * nmemb;
+                     // a redirect starts a new response, only the headers of the last one count
+                     if (len >= 5 && strncmp(line, "HTTP/", 5) == 0) {
+                       r->etag.clear();
+                       r->last_modified.clear();
+                     }
+                     if (!MatchHeader(line, len, "etag:", &r->etag)) {
+                       MatchHeader(line, len, "last-modified:", &r->last_modified);
+                     }
+                     return len;
+                   }));
+  if (file) {
+    response->file = file;
+    curl_easy_setopt(curl_, CURLOPT_WRITEDATA, response);
+    curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION,
+                     static_cast<curl_write_callback>([](char* data, size_t size, size_t nmemb, void* userdata) {
+                       Response* r = static_cast<Response*>(userdata);
+                       const size_t len = size * nmemb;
+                       // hashed on the way to disk, the file is never read back
+                       r->hasher.Update(data, len);
+                       r->received += len;
+                       return fwrite(data, 1, len, r->file);
+                     }));
+  } else {
+    curl_easy_setopt(curl_, CURLOPT_NOBODY, 1L);
+  }
+
+  CURLcode code = curl_easy_perform(curl_);
+  curl_off_t length = -1;
+  curl_easy_getinfo(curl_, CURLINFO_RESPONSE_CODE, &result->http_status);
+  curl_easy_getinfo(curl_, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+  response->length = length;
+  result->code = code;
+  if (code != CURLE_OK) result->error = error[0] ? error : curl_easy_strerror(code);
+  return code;
+}
+
+bool ModelCache::IsIntact(const std::string& key, const Entry& entry) const {
+  const std::string path = GetBlobPath(key);
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0 || st.st_size != entry.size) return false;
+  if (!verify_on_hit_) return true;
+
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) return false;
+  Xxh64 hasher;
+  std::vector<char> buf(1 << 20);
+  size_t n;
+  while ((n = fread(buf.data(), 1, buf.size(), file)) > 0) hasher.Update(buf.data(), n);
+  bool read_ok = !ferror(file);
+  fclose(file);
+  return read_ok && hasher.Digest() == entry.content_hash;
+}
+
+void ModelCache::Touch(Entry* entry) {
+  entry->last_use = ++tick_;
+}
+
+void ModelCache::Drop(const std::string& key) {
+  auto it = entries_.find(key);
+  if (it == entries_.end()) return;
+  std::remove(GetBlobPath(key).c_str());
+  total_bytes_ -= it->second.size;
+  entries_.erase(it);
+}
+
+void ModelCache::Evict(const std::string& keep_key) {
+  while (total_bytes_ > max_bytes_) {
+    auto victim = entries_.end();
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+      if (it->first == keep_key) continue;
+      if (victim == entries_.end() || it->second.last_use < victim->second.last_use) victim = it;
+    }
+    if (victim == entries_.end()) break;
+    Drop(victim->first);
+  }
+}
+
+void ModelCache::SetMaxBytes(int64_t max_bytes) {
+  max_bytes_ = max_bytes;
+  Evict({});
+  SaveIndex();
+}
+
+size_t ModelCache::Remove(const std::string& url) {
+  std::vector<std::string> keys;
+  for (const auto& kv : entries_) {
+    if (kv.second.url == url) keys.push_back(kv.first);
+  }
+  for (const std::string& key : keys) Drop(key);
+  if (!keys.empty()) SaveIndex();
+  return keys.size();
+}
+
+DownloadResult ModelCache::Fetch(const std::string& url, uint64_t expected_hash) {
+  DownloadResult result;
+  result.url = url;
+
+  Response head;
+  if (Request(url, nullptr, &head, &result) != CURLE_OK) {
+    // no answer at all, e.g. offline: the newest intact version will do. An HTTP error is passed on
+    if (result.http_status != 0) return result;
+    auto newest = entries_.end();
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+      if (it->second.url != url || (expected_hash && it->second.content_hash != expected_hash)) continue;
+      if (newest == entries_.end() || it->second.last_use > newest->second.last_use) newest = it;
+    }
+    if (newest != entries_.end() && IsIntact(newest->first, newest->second)) {
+      Touch(&newest->second);
+      SaveIndex();
+      result.file_path = GetBlobPath(newest->first);
+    }
+    return result;
+  }
+
+  std::string version = head.Version();
+  if (version.empty() && expected_hash) version = ToHex(expected_hash);
+  std::string key = MakeKey(url, version);
+  auto it = entries_.find(key);
+  // without a validator a changed file would look like the cached one, so nothing is a hit then
+  if (it != entries_.end() && !version.empty()) {
+    if (IsIntact(key, it->second) && (!expected_hash || it->second.content_hash == expected_hash)) {
+      Touch(&it->second);
+      SaveIndex();
+      result.file_path = GetBlobPath(key);
+      return result;
+    }
+    std::cerr << "model cache entry damaged or not the expected content, download again: " << url << "\n";
+    Drop(key);
+  }
+
+  // unique per key, and in the cache directory so the rename stays on one file system
+  const std::string tmp_path = GetBlobPath(key) + ".tmp";
+  FILE* file = fopen(tmp_path.c_str(), "wb");
+  if (!file) {
+    result.code = CURLE_WRITE_ERROR;
+    result.error = "can not open " + tmp_path + ": " + std::strerror(errno);
+    return result;
+  }
+  Response get;
+  CURLcode code = Request(url, file, &get, &result);
+  // on disk before the rename publishes it
+  bool written = fflush(file) == 0 && fsync(fileno(file)) == 0;
+  written = fclose(file) == 0 && written;
+  const uint64_t content_hash = get.hasher.Digest();
+  if (code == CURLE_OK && !written) {
+    code = CURLE_WRITE_ERROR;
+    result.error = "can not write " + tmp_path;
+  } else if (code == CURLE_OK && expected_hash && content_hash != expected_hash) {
+    code = CURLE_BAD_CONTENT_ENCODING;
+    result.error = "content hash " + ToHex(content_hash) + " does not match expected " + ToHex(expected_hash);
+  }
+  if (code != CURLE_OK) {
+    result.code = code;
+    std::remove(tmp_path.c_str());
+    return result;
+  }
+
+  // the file may have changed between the two requests, the entry describes what was downloaded
+  const std::string got_version = get.Version();
+  if (!got_version.empty() && got_version != version) {
+    version = got_version;
+    key = MakeKey(url, version);
+  }
+  // older versions of the url are stale from now on
+  std::vector<std::string> stale;
+  for (const auto& kv : entries_) {
+    if (kv.second.url == url) stale.push_back(kv.first);
+  }
+  for (const std::string& k : stale) Drop(k);
+
+  const std::string blob_path = GetBlobPath(key);
+  if (std::rename(tmp_path.c_str(), blob_path.c_str()) != 0) {
+    result.code = CURLE_WRITE_ERROR;
+    result.error = "can not publish " + blob_path + ": " + std::strerror(errno);
+    std::remove(tmp_path.c_str());
+    SaveIndex();
+    return result;
+  }
+  Entry& entry = entries_[key];
+  entry.content_hash = content_hash;
+  entry.size = get.received;
+  entry.url = url;
+  entry.version = version;
+  Touch(&entry);
+  total_bytes_ += entry.size;
+  Evict(key);
+  SaveIndex();
+
+  result.file_path = blob_path;
+  return result;
+}
@@ -0,0 +1,103 @@
+/**
+ * @file model_cache.h
+ *
+ * This file contains a declaration of ModelCache, a size-bounded on-disk cache of downloaded files keyed by url and
+ * version.
+ */
+
+#ifndef CXXUTIL_MODEL_CACHE_H_
+#define CXXUTIL_MODEL_CACHE_H_
+
+#include <curl/curl.h>
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+#include "curl_downloader.h"
+
+/**
+ * @brief Content-addressed cache of downloaded files in one directory
+ *
+ * An entry is keyed by the url and the version the server reports, its ETag, or Last-Modified and length when there
+ * is none, so a changed file on the server is a miss instead of a stale hit. A server reporting neither, for a Fetch
+ * without expected hash, has nothing to tell versions apart: such a Fetch always downloads again. Every Fetch asks
+ * the server with a HEAD request; when the server can not be reached the newest cached version of the url is served,
+ * the result then keeps the error of that request.
+ *
+ * A download goes to a temporary file in the cache directory, hashed with XXH64 while it streams, and is published by
+ * rename only once complete and, if the caller gave one, matching the expected hash. A crash leaves a temporary file,
+ * never a truncated entry. A hit checks the file size, and rehashes the file with SetVerifyOnHit.
+ *
+ * Entries are listed in a small text index, loaded at construction, so startup reads one file whatever the number of
+ * entries. Temporary files and blobs missing from the index, left by a crash, are deleted then, unless the index
+ * could not be read. Past max_bytes the least recently used entries are evicted. One process per cache directory,
+ * not thread-safe.
+ */
+class ModelCache {
+ public:
+  static constexpr int64_t kDefaultMaxBytes = int64_t(16) << 30;
+
+  explicit ModelCache(const std::string& cache_dir, int64_t max_bytes = kDefaultMaxBytes);
+  ~ModelCache();
+
+  ModelCache(const ModelCache&) = delete;
+  ModelCache& operator=(const ModelCache&) = delete;
+
+  /**
+   * @brief Path of the cached copy of url, downloaded first on a miss
+   *
+   * @param expected_hash XXH64 of the content when known, 0 otherwise. A download not matching it is discarded
+   */
+  DownloadResult Fetch(const std::string& url, uint64_t expected_hash = 0);
+
+  /**
+   * @brief Drops every entry of url, returns how many there were
+   */
+  size_t Remove(const std::string& url);
+
+  void SetVerifyOnHit(bool verify) { verify_on_hit_ = verify; }
+  void SetMaxBytes(int64_t max_bytes);
+
+  int64_t GetTotalBytes() const { return total_bytes_; }
+  size_t GetEntryNum() const { return entries_.size(); }
+  const std::string& GetCacheDir() const { return cache_dir_; }
+
+ private:
+  struct Entry {
+    uint64_t content_hash = 0;
+    int64_t size = 0;
+    uint64_t last_use = 0;
+    std::string url;
+    std::string version;
+  };
+
+  struct Response;
+
+  static std::string MakeKey(const std::string& url, const std::string& version);
+  std::string GetBlobPath(const std::string& key) const { return cache_dir_ + "/" + key; }
+
+  bool LoadIndex();
+  bool SaveIndex() const;
+  // deletes temporary files and blobs without an entry, one pass over the directory
+  void RemoveOrphans();
+
+  // performs a HEAD, or a GET into file hashing the body when file is set
+  CURLcode Request(const std::string& url, FILE* file, Response* response, DownloadResult* result);
+  bool IsIntact(const std::string& key, const Entry& entry) const;
+  void Touch(Entry* entry);
+  void Drop(const std::string& key);
+  void Evict(const std::string& keep_key);
+
+  std::string cache_dir_;
+  int64_t max_bytes_;
+  bool verify_on_hit_ = false;
+  CURL* curl_ = nullptr;
+  // key -> entry, key is the hex XXH64 of url and version and the file name of the blob
+  std::unordered_map<std::string, Entry> entries_;
+  int64_t total_bytes_ = 0;
+  // logical clock of last_use
+  uint64_t tick_ = 0;
+};  // ModelCache
+
+#endif  // CXXUTIL_MODEL_CACHE_H_
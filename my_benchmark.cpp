@@ -1,4 +1,10 @@
 #include <benchmark/benchmark.h>
+
 #include "benchmark_map.h"
+#include "benchmark_flat_map.h"
+#include "benchmark_perfect_hash.h"
+#include "benchmark_any.h"
+#include "lock_benchmark.h"
+#include "benchmark_thread_pool.h"
 
 BENCHMARK_MAIN();
@@ -0,0 +1,210 @@
+/**
+ * @file perfect_hash.h
+ *
+ * This file contains a declaration of PerfectHashMap and PerfectHashSet, lookup tables over string keys fixed at
+ * compile time, whose collision-free layout is computed by the compiler.
+ */
+
+#ifndef CXXUTIL_PERFECT_HASH_H_
+#define CXXUTIL_PERFECT_HASH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+namespace detail {
+
+constexpr uint64_t kFnvOffsetBasis = 14695981039346656037ull;
+constexpr uint64_t kFnvPrime = 1099511628211ull;
+
+constexpr uint64_t Fnv1a(std::string_view str, uint64_t seed = 0) {
+  uint64_t h = kFnvOffsetBasis ^ seed;
+  for (char c : str) {
+    h ^= static_cast<uint8_t>(c);
+    h *= kFnvPrime;
+  }
+  return h;
+}
+
+// murmur3 finalizer, spreads the displacement over all bits of the slot
+constexpr uint64_t MixSlot(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+constexpr size_t NextPow2(size_t n) {
+  size_t p = 1;
+  while (p < n) p *= 2;
+  return p;
+}
+
+/**
+ * @brief Slot layout shared by PerfectHashMap and PerfectHashSet, built by hash and displace
+ *
+ * Keys are hashed once with FNV-1a and grouped into buckets by the low hash bits. Buckets are placed largest first,
+ * each gets the smallest displacement under which all its keys land in distinct free slots.
+ * A lookup is then one FNV pass over the key, an integer mix, and one key comparison.
+ */
+template <size_t N>
+class PerfectHashIndex {
+  static_assert(N > 0, "PerfectHashIndex requires at least one key");
+
+ public:
+  /// slots at load factor at most 1/2, enough for a displacement to be found quickly
+  static constexpr size_t kCapacity = NextPow2(2 * N);
+  static constexpr size_t kBucketNum = NextPow2((N + 1) / 2);
+  static constexpr size_t kNotFound = static_cast<size_t>(-1);
+
+  constexpr explicit PerfectHashIndex(const std::string_view (&keys)[N]) {
+    uint64_t hashes[N] = {};
+    for (size_t i = 0; i < N; ++i) {
+      for (size_t j = 0; j < i; ++j) {
+        if (keys[i] == keys[j]) throw std::invalid_argument("PerfectHashIndex: duplicate key");
+      }
+      hashes[i] = Fnv1a(keys[i], kSeed);
+    }
+
+    // keys grouped by bucket, buckets in order of decreasing size
+    size_t bucket_size[kBucketNum] = {};
+    for (size_t i = 0; i < N; ++i) ++bucket_size[hashes[i] & (kBucketNum - 1)];
+    size_t order[kBucketNum] = {};
+    for (size_t b = 0; b < kBucketNum; ++b) order[b] = b;
+    for (size_t a = 0; a < kBucketNum; ++a) {
+      for (size_t b = a + 1; b < kBucketNum; ++b) {
+        if (bucket_size[order[b]] > bucket_size[order[a]]) {
+          size_t t = order[a];
+          order[a] = order[b];
+          order[b] = t;
+        }
+      }
+    }
+
+    bool taken[kCapacity] = {};
+    for (size_t slot = 0; slot < kCapacity; ++slot) entry_[slot] = kNotFound;
+    for (size_t o = 0; o < kBucketNum && bucket_size[order[o]]; ++o) {
+      const size_t bucket = order[o];
+      size_t members[N] = {};
+      size_t member_num = 0;
+      for (size_t i = 0; i < N; ++i) {
+        if ((hashes[i] & (kBucketNum - 1)) == bucket) members[member_num++] = i;
+      }
+      bool placed = false;
+      for (uint64_t d = 1; !placed && d < kMaxDisplacement; ++d) {
+        size_t slots[N] = {};
+        placed = true;
+        for (size_t m = 0; placed && m < member_num; ++m) {
+          slots[m] = MixSlot(hashes[members[m]] ^ d) & (kCapacity - 1);
+          if (taken[slots[m]]) placed = false;
+          for (size_t k = 0; placed && k < m; ++k) {
+            if (slots[k] == slots[m]) placed = false;
+          }
+        }
+        if (!placed) continue;
+        displacement_[bucket] = d;
+        for (size_t m = 0; m < member_num; ++m) {
+          taken[slots[m]] = true;
+          entry_[slots[m]] = members[m];
+          keys_[slots[m]] = keys[members[m]];
+        }
+      }
+      // two keys with equal 64-bit hashes can not be separated
+      if (!placed) throw std::invalid_argument("PerfectHashIndex: no displacement found, change kSeed");
+    }
+  }
+
+  /**
+   * @return position of key in the construction list, kNotFound if absent
+   */
+  constexpr size_t Find(std::string_view key) const {
+    const uint64_t h = Fnv1a(key, kSeed);
+    const size_t slot = MixSlot(h ^ displacement_[h & (kBucketNum - 1)]) & (kCapacity - 1);
+    return entry_[slot] != kNotFound && keys_[slot] == key ? entry_[slot] : kNotFound;
+  }
+
+ private:
+  static constexpr uint64_t kSeed = 0;
+  static constexpr uint64_t kMaxDisplacement = 1 << 20;
+
+  uint64_t displacement_[kBucketNum] = {};
+  size_t entry_[kCapacity] = {};
+  std::string_view keys_[kCapacity] = {};
+};  // PerfectHashIndex
+
+}  // namespace detail
+
+/**
+ * @brief Read-only map from a fixed set of strings, usable in constant expressions
+ *
+ * Build with MakePerfectHashMap, at namespace or function scope as `static constexpr`, so the table is laid out by the
+ * compiler and lives in read-only data. Keys are views, the strings must outlive the map (literals do).
+ */
+template <typename Value, size_t N>
+class PerfectHashMap {
+ public:
+  using Entry = std::pair<std::string_view, Value>;
+
+  constexpr explicit PerfectHashMap(const Entry (&entries)[N])
+      : PerfectHashMap(entries, std::make_index_sequence<N>()) {}
+
+  /**
+   * @return pointer to the value of key, nullptr if absent
+   */
+  constexpr const Value* find(std::string_view key) const {
+    size_t idx = index_.Find(key);
+    return idx == Index::kNotFound ? nullptr : &values_[idx];
+  }
+
+  constexpr bool contains(std::string_view key) const { return index_.Find(key) != Index::kNotFound; }
+  constexpr size_t size() const { return N; }
+
+ private:
+  using Index = detail::PerfectHashIndex<N>;
+
+  template <size_t... I>
+  constexpr PerfectHashMap(const Entry (&entries)[N], std::index_sequence<I...>)
+      : index_({entries[I].first...}), values_{entries[I].second...} {}
+
+  Index index_;
+  Value values_[N];
+};  // PerfectHashMap
+
+/**
+ * @brief Read-only set of strings fixed at compile time, see PerfectHashMap
+ */
+template <size_t N>
+class PerfectHashSet {
+ public:
+  constexpr explicit PerfectHashSet(const std::string_view (&keys)[N]) : index_(keys) {}
+
+  constexpr bool contains(std::string_view key) const {
+    return index_.Find(key) != detail::PerfectHashIndex<N>::kNotFound;
+  }
+  constexpr size_t size() const { return N; }
+
+ private:
+  detail::PerfectHashIndex<N> index_;
+};  // PerfectHashSet
+
+/**
+ * @brief Deduces the size, `MakePerfectHashMap<int>({{"int", 1}, {"float", 2}})`
+ */
+template <typename Value, size_t N>
+constexpr PerfectHashMap<Value, N> MakePerfectHashMap(const std::pair<std::string_view, Value> (&entries)[N]) {
+  return PerfectHashMap<Value, N>(entries);
+}
+
+/**
+ * @brief Deduces the size, `MakePerfectHashSet({"http", "https", "ftp"})`
+ */
+template <size_t N>
+constexpr PerfectHashSet<N> MakePerfectHashSet(const std::string_view (&keys)[N]) {
+  return PerfectHashSet<N>(keys);
+}
+
+#endif  // CXXUTIL_PERFECT_HASH_H_
@@ -0,0 +1,135 @@
+/**
+ * @file pool_allocator.h
+ *
+ * This file contains a declaration of ThreadCachePool, per-thread free lists of small blocks,
+ * and PoolAllocator, a standard allocator on top of it.
+ */
+
+#ifndef CXXUTIL_POOL_ALLOCATOR_H_
+#define CXXUTIL_POOL_ALLOCATOR_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+
+/**
+ * @brief Caches freed small blocks per thread, so an allocate / deallocate pair is a free-list pop and push
+ *
+ * Blocks are grouped in size classes of kGranularity bytes up to kMaxBlockSize, bigger requests go straight to
+ * operator new. Every block is an ordinary operator new allocation, so a block may be freed on another thread than
+ * the one which allocated it: it just joins the cache of the freeing thread. Each class caches at most
+ * kMaxCachedBlocks, the rest is returned, and a thread's cache is released when the thread exits. Blocks freed
+ * after that, e.g. by a thread_local destroyed after the cache, go straight back to operator delete.
+ */
+class ThreadCachePool {
+ public:
+  static constexpr size_t kGranularity = alignof(std::max_align_t);
+  static constexpr size_t kMaxBlockSize = 256;
+  static constexpr size_t kMaxCachedBlocks = 256;
+
+  static void* Allocate(size_t size) {
+    if (size > kMaxBlockSize) return ::operator new(size);
+    const size_t cls = SizeClass(size);
+    Cache* cache = LocalCache();
+    if (!cache) return ::operator new((cls + 1) * kGranularity);
+    FreeList& list = cache->lists[cls];
+    if (FreeBlock* block = list.head) {
+      list.head = block->next;
+      --list.count;
+      return block;
+    }
+    return ::operator new((cls + 1) * kGranularity);
+  }
+
+  static void Deallocate(void* p, size_t size) noexcept {
+    if (size > kMaxBlockSize) {
+      ::operator delete(p);
+      return;
+    }
+    Cache* cache = LocalCache();
+    FreeList* list = cache ? &cache->lists[SizeClass(size)] : nullptr;
+    if (!list || list->count == kMaxCachedBlocks) {
+      ::operator delete(p);
+      return;
+    }
+    FreeBlock* block = static_cast<FreeBlock*>(p);
+    block->next = list->head;
+    list->head = block;
+    ++list->count;
+  }
+
+ private:
+  static constexpr size_t kClassNum = kMaxBlockSize / kGranularity;
+
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  struct FreeList {
+    FreeBlock* head = nullptr;
+    size_t count = 0;
+  };
+
+  enum class CacheState : uint8_t { kNone, kAlive, kDestroyed };
+
+  struct Cache {
+    Cache() { LocalCacheState() = CacheState::kAlive; }
+    ~Cache() {
+      LocalCacheState() = CacheState::kDestroyed;
+      for (FreeList& list : lists) {
+        while (FreeBlock* block = list.head) {
+          list.head = block->next;
+          ::operator delete(block);
+        }
+      }
+    }
+    FreeList lists[kClassNum];
+  };
+
+  // 0 for 1 ~ kGranularity bytes, and 0 bytes too
+  static size_t SizeClass(size_t size) { return size ? (size - 1) / kGranularity : 0; }
+
+  // trivially destructible, so it stays readable until the thread is gone
+  static CacheState& LocalCacheState() {
+    static thread_local CacheState state = CacheState::kNone;
+    return state;
+  }
+
+  // nullptr once the cache of the calling thread has been destroyed
+  static Cache* LocalCache() {
+    if (LocalCacheState() == CacheState::kDestroyed) return nullptr;
+    static thread_local Cache cache;
+    return &cache;
+  }
+};  // ThreadCachePool
+
+/**
+ * @brief Stateless allocator drawing from ThreadCachePool, for types aligned to at most max_align_t
+ */
+template <typename T>
+class PoolAllocator {
+  static_assert(alignof(T) <= ThreadCachePool::kGranularity, "PoolAllocator does not support over-aligned types");
+
+ public:
+  using value_type = T;
+  using is_always_equal = std::true_type;
+
+  PoolAllocator() noexcept = default;
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+  T* allocate(size_t n) { return static_cast<T*>(ThreadCachePool::Allocate(n * sizeof(T))); }
+  void deallocate(T* p, size_t n) noexcept { ThreadCachePool::Deallocate(p, n * sizeof(T)); }
+
+  template <typename U>
+  friend bool operator==(const PoolAllocator&, const PoolAllocator<U>&) noexcept {
+    return true;
+  }
+  template <typename U>
+  friend bool operator!=(const PoolAllocator&, const PoolAllocator<U>&) noexcept {
+    return false;
+  }
+};  // PoolAllocator
+
+#endif  // CXXUTIL_POOL_ALLOCATOR_H_
@@ -0,0 +1,296 @@
+/**
+ * @file property_bag.h
+ *
+ * This file contains a declaration of PropertySchema, PropertyKey and PropertyBag, a heterogeneous store whose fields
+ * are typed at compile time and laid out in one buffer.
+ */
+
+#ifndef CXXUTIL_PROPERTY_BAG_H_
+#define CXXUTIL_PROPERTY_BAG_H_
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class PropertySchema;
+
+/**
+ * @brief Typed handle of one field, handed out by PropertySchema::Add
+ *
+ * The type travels with the key, so accessing a bag through it needs no type check, only the presence bit.
+ */
+template <typename T>
+class PropertyKey {
+ public:
+  PropertyKey() = default;
+
+  size_t offset() const { return offset_; }
+  size_t index() const { return index_; }
+
+ private:
+  friend class PropertySchema;
+  friend class PropertyBag;
+
+  PropertyKey(const PropertySchema* schema, size_t offset, size_t index)
+      : schema_(schema), offset_(offset), index_(index) {}
+
+  const PropertySchema* schema_ = nullptr;
+  size_t offset_ = 0;
+  size_t index_ = 0;
+};  // PropertyKey
+
+/**
+ * @brief Field layout shared by a family of PropertyBag
+ *
+ * Each Add reserves an aligned slot in the buffer and a presence bit, in declaration order.
+ * Declare all fields before the first bag is made, the layout is frozen from then on. The schema must outlive its bags.
+ */
+class PropertySchema {
+ public:
+  PropertySchema() = default;
+  PropertySchema(const PropertySchema&) = delete;
+  PropertySchema& operator=(const PropertySchema&) = delete;
+
+  template <typename T>
+  PropertyKey<T> Add(std::string name) {
+    static_assert(std::is_same<T, typename std::decay<T>::type>::value, "PropertyKey type must be a plain value type");
+    if (frozen_) throw std::logic_error("PropertySchema: field added after a bag was made");
+    const size_t offset = (size_ + alignof(T) - 1) & ~(alignof(T) - 1);
+    Field field;
+    field.name = std::move(name);
+    field.offset = offset;
+    if (!std::is_trivially_destructible<T>::value) {
+      field.destroy = [](void* p) { static_cast<T*>(p)->~T(); };
+    }
+    if (!std::is_trivially_copyable<T>::value) {
+      field.copy = [](void* dst, const void* src) { new (dst) T(*static_cast<const T*>(src)); };
+    }
+    trivial_ = trivial_ && !field.destroy && !field.copy;
+    fields_.push_back(std::move(field));
+    size_ = offset + sizeof(T);
+    if (alignof(T) > align_) align_ = alignof(T);
+    return PropertyKey<T>(this, offset, fields_.size() - 1);
+  }
+
+  size_t size() const { return size_; }
+  size_t field_num() const { return fields_.size(); }
+  const std::string& name(size_t index) const { return fields_[index].name; }
+
+ private:
+  friend class PropertyBag;
+
+  struct Field {
+    std::string name;
+    size_t offset = 0;
+    // nullptr for trivial types, handled with memcpy / nothing
+    void (*destroy)(void*) = nullptr;
+    void (*copy)(void*, const void*) = nullptr;
+  };
+
+  std::vector<Field> fields_;
+  size_t size_ = 0;
+  size_t align_ = alignof(std::max_align_t);
+  // no field needs a destructor or copy constructor, so whole-buffer memcpy and bit clearing are enough
+  bool trivial_ = true;
+  mutable bool frozen_ = false;
+};  // PropertySchema
+
+/**
+ * @brief Values of the fields of one PropertySchema, in a single buffer allocated once
+ *
+ * Access through a PropertyKey is an offset and a presence bit, without type check or allocation.
+ * Reset empties the bag keeping the buffer, so one bag can be reused frame after frame, and copying a bag of trivial
+ * fields is one memcpy. Not thread-safe.
+ *
+ * @code
+ * PropertySchema schema;
+ * const auto kFrameId = schema.Add<int64_t>("frame_id");
+ * PropertyBag bag(schema);
+ * bag.Set(kFrameId, 7);
+ * int64_t id = bag.Get(kFrameId);
+ * @endcode
+ */
+class PropertyBag {
+ public:
+  explicit PropertyBag(const PropertySchema& schema)
+      : schema_(&schema),
+        buffer_(static_cast<char*>(::operator new(schema.size(), std::align_val_t(schema.align_)))),
+        present_((schema.field_num() + 63) / 64) {
+    schema.frozen_ = true;
+  }
+
+  PropertyBag(const PropertyBag& other) : PropertyBag(*other.schema_) { CopyFrom(other); }
+
+  // other is left an empty bag of the same schema, still usable, so this allocates a buffer for it
+  PropertyBag(PropertyBag&& other) : PropertyBag(*other.schema_) {
+    std::swap(buffer_, other.buffer_);
+    std::swap(present_, other.present_);
+  }
+
+  PropertyBag& operator=(const PropertyBag& other) {
+    if (this != &other) {
+      // the buffer is laid out for one schema
+      if (schema_ != other.schema_) throw std::invalid_argument("PropertyBag: assigned a bag of another schema");
+      Reset();
+      CopyFrom(other);
+    }
+    return *this;
+  }
+
+  PropertyBag& operator=(PropertyBag&& other) noexcept {
+    std::swap(schema_, other.schema_);
+    std::swap(buffer_, other.buffer_);
+    std::swap(present_, other.present_);
+    return *this;
+  }
+
+  ~PropertyBag() {
+    if (!buffer_) return;
+    Reset();
+    ::operator delete(buffer_, std::align_val_t(schema_->align_));
+  }
+
+  template <typename T>
+  bool Has(const PropertyKey<T>& key) const {
+    return (present_[key.index_ / 64] >> (key.index_ % 64)) & 1;
+  }
+
+  /**
+   * @brief Constructs the value in place, replacing the previous one
+   */
+  template <typename T, typename... Args>
+  T& Emplace(const PropertyKey<T>& key, Args&&... args) {
+    assert(key.schema_ == schema_);
+    if (Has(key)) Slot(key)->~T();
+    // cleared first, if the constructor throws the field stays absent
+    ClearBit(key.index_);
+    T* p = new (buffer_ + key.offset_) T(std::forward<Args>(args)...);
+    SetBit(key.index_);
+    return *p;
+  }
+
+  template <typename T, typename U>
+  T& Set(const PropertyKey<T>& key, U&& value) {
+    if (Has(key)) return *Slot(key) = std::forward<U>(value);
+    return Emplace(key, std::forward<U>(value));
+  }
+
+  /**
+   * @brief The field must be present, see Find
+   */
+  template <typename T>
+  T& Get(const PropertyKey<T>& key) {
+    assert(key.schema_ == schema_ && Has(key));
+    return *Slot(key);
+  }
+  template <typename T>
+  const T& Get(const PropertyKey<T>& key) const {
+    return const_cast<PropertyBag*>(this)->Get(key);
+  }
+
+  /**
+   * @return pointer to the value, nullptr if the field is absent
+   */
+  template <typename T>
+  T* Find(const PropertyKey<T>& key) {
+    assert(key.schema_ == schema_);
+    return Has(key) ? Slot(key) : nullptr;
+  }
+  template <typename T>
+  const T* Find(const PropertyKey<T>& key) const {
+    return const_cast<PropertyBag*>(this)->Find(key);
+  }
+
+  template <typename T>
+  void Erase(const PropertyKey<T>& key) {
+    assert(key.schema_ == schema_);
+    if (!Has(key)) return;
+    Slot(key)->~T();
+    ClearBit(key.index_);
+  }
+
+  /**
+   * @brief Destroys all values, the buffer is kept for the next round
+   */
+  void Reset() {
+    if (!schema_->trivial_) {
+      ForEachPresent([this](size_t i) {
+        const PropertySchema::Field& field = schema_->fields_[i];
+        if (field.destroy) field.destroy(buffer_ + field.offset);
+      });
+    }
+    std::fill(present_.begin(), present_.end(), 0);
+  }
+
+  PropertyBag Clone() const { return *this; }
+
+  size_t size() const {
+    size_t n = 0;
+    for (uint64_t word : present_) n += __builtin_popcountll(word);
+    return n;
+  }
+  bool empty() const {
+    for (uint64_t word : present_) {
+      if (word) return false;
+    }
+    return true;
+  }
+
+  const PropertySchema& schema() const { return *schema_; }
+
+ private:
+  template <typename T>
+  T* Slot(const PropertyKey<T>& key) {
+    return std::launder(reinterpret_cast<T*>(buffer_ + key.offset_));
+  }
+
+  void SetBit(size_t i) { present_[i / 64] |= uint64_t(1) << (i % 64); }
+  void ClearBit(size_t i) { present_[i / 64] &= ~(uint64_t(1) << (i % 64)); }
+
+  template <typename Func>
+  void ForEachPresent(Func&& func) const {
+    for (size_t w = 0; w < present_.size(); ++w) {
+      for (uint64_t word = present_[w]; word; word &= word - 1) {
+        func(w * 64 + __builtin_ctzll(word));
+      }
+    }
+  }
+
+  // this bag is empty
+  void CopyFrom(const PropertyBag& other) {
+    if (schema_->trivial_) {
+      std::memcpy(buffer_, other.buffer_, schema_->size());
+      present_ = other.present_;
+      return;
+    }
+    other.ForEachPresent([this, &other](size_t i) {
+      const PropertySchema::Field& field = schema_->fields_[i];
+      if (field.copy) {
+        field.copy(buffer_ + field.offset, other.buffer_ + field.offset);
+      } else {
+        std::memcpy(buffer_ + field.offset, other.buffer_ + field.offset, FieldSize(i));
+      }
+      SetBit(i);
+    });
+  }
+
+  // trivial fields are copied up to the next field, padding included
+  size_t FieldSize(size_t i) const {
+    return (i + 1 < schema_->fields_.size() ? schema_->fields_[i + 1].offset : schema_->size()) -
+           schema_->fields_[i].offset;
+  }
+
+  const PropertySchema* schema_;
+  char* buffer_;
+  std::vector<uint64_t> present_;
+};  // PropertyBag
+
+#endif  // CXXUTIL_PROPERTY_BAG_H_
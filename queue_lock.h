@@ -0,0 +1,201 @@
+/**
+ * @file queue_lock.h
+ *
+ * This file contains declarations of fair spin locks: TicketLock and McsLock.
+ * They share the Lock/TryLock/Unlock interface of SpinLock and work with BasicSpinLockGuard.
+ */
+
+#ifndef CXXUTIL_QUEUE_LOCK_H_
+#define CXXUTIL_QUEUE_LOCK_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+#include "spinlock.h"
+
+/**
+ * @brief Ticket lock, grants the lock in FIFO order
+ *
+ * Waiters still poll one shared counter, but back off in proportion to their distance from the head of the queue.
+ */
+class TicketLock {
+ public:
+  /**
+   * @brief Take a ticket and wait until it is served
+   */
+  void Lock() {
+    const uint32_t ticket = next_.fetch_add(1, std::memory_order_relaxed);
+    uint32_t spin_count = 0;
+    for (;;) {
+      const uint32_t serving = serving_.load(std::memory_order_acquire);
+      if (serving == ticket) return;
+      if (spin_count < kSpinCount) {
+        spin_count += ticket - serving;
+        for (uint32_t i = ticket - serving; i > 0; --i) CpuRelax();
+      } else {
+        // holder or a predecessor may be preempted, do not burn the timeslice
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  /**
+   * @brief Lock only if nobody holds or waits for the lock
+   * @return true if lock is acquired
+   */
+  bool TryLock() {
+    uint32_t serving = serving_.load(std::memory_order_relaxed);
+    return next_.compare_exchange_strong(serving, serving + 1, std::memory_order_acquire, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Serve the next ticket
+   */
+  void Unlock() {
+    serving_.store(serving_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  /**
+   * @brief Query lock status
+   * @return ture if is locked
+   */
+  bool IsLocked() const {
+    return next_.load(std::memory_order_acquire) != serving_.load(std::memory_order_acquire);
+  }
+
+ private:
+  static constexpr uint32_t kSpinCount = 256;
+
+  alignas(kCacheLineSize) std::atomic<uint32_t> next_{0};
+  alignas(kCacheLineSize) std::atomic<uint32_t> serving_{0};
+};
+
+/**
+ * @brief MCS queue lock, grants the lock in FIFO order and every waiter spins on its own cache line
+ *
+ * Queue nodes come from a small per-thread pool, so Lock and Unlock must be called by the same thread.
+ * A thread holding more than kMaxNested MCS locks at the same time gets the extra nodes from the heap.
+ */
+class McsLock {
+ public:
+  static constexpr int kMaxNested = 32;
+
+  /**
+   * @brief Enqueue and wait until predecessor hands over the lock
+   */
+  void Lock() {
+    Node* node = AcquireNode();
+    Node* pred = tail_.exchange(node, std::memory_order_acq_rel);
+    if (pred) {
+      pred->next.store(node, std::memory_order_release);
+      uint32_t spin_count = 0;
+      while (node->locked.load(std::memory_order_acquire)) {
+        if (spin_count < kSpinCount) {
+          ++spin_count;
+          CpuRelax();
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    }
+    holder_ = node;
+  }
+
+  /**
+   * @brief Lock only if the queue is empty
+   * @return true if lock is acquired
+   */
+  bool TryLock() {
+    if (tail_.load(std::memory_order_relaxed)) return false;
+    Node* node = AcquireNode();
+    Node* expected = nullptr;
+    if (tail_.compare_exchange_strong(expected, node, std::memory_order_acquire, std::memory_order_relaxed)) {
+      holder_ = node;
+      return true;
+    }
+    ReleaseNode(node);
+    return false;
+  }
+
+  /**
+   * @brief Hand over the lock to successor, or empty the queue
+   */
+  void Unlock() {
+    Node* node = holder_;
+    Node* next = node->next.load(std::memory_order_acquire);
+    if (!next) {
+      Node* expected = node;
+      if (tail_.compare_exchange_strong(expected, nullptr, std::memory_order_release, std::memory_order_relaxed)) {
+        ReleaseNode(node);
+        return;
+      }
+      // successor has swapped tail but not linked itself yet
+      while (!(next = node->next.load(std::memory_order_acquire))) CpuRelax();
+    }
+    next->locked.store(false, std::memory_order_release);
+    ReleaseNode(node);
+  }
+
+  /**
+   * @brief Query lock status
+   * @return ture if is locked
+   */
+  bool IsLocked() const {
+    return tail_.load(std::memory_order_acquire) != nullptr;
+  }
+
+ private:
+  static constexpr uint32_t kSpinCount = 256;
+
+  struct alignas(kCacheLineSize) Node {
+    std::atomic<Node*> next{nullptr};
+    std::atomic<bool> locked{false};
+  };
+
+  struct NodePool {
+    Node nodes[kMaxNested];
+    uint32_t used = 0;
+  };
+
+  static NodePool& LocalPool() {
+    static thread_local NodePool pool;
+    return pool;
+  }
+
+  static Node* AcquireNode() {
+    NodePool& pool = LocalPool();
+    Node* node = nullptr;
+    if (pool.used != ~uint32_t(0)) {
+      const int idx = __builtin_ctz(~pool.used);
+      pool.used |= uint32_t(1) << idx;
+      node = &pool.nodes[idx];
+    } else {
+      // pool exhausted, __builtin_ctz(0) would be undefined
+      node = new Node;
+    }
+    node->next.store(nullptr, std::memory_order_relaxed);
+    node->locked.store(true, std::memory_order_relaxed);
+    return node;
+  }
+
+  static void ReleaseNode(Node* node) {
+    NodePool& pool = LocalPool();
+    const std::less<const Node*> before;
+    if (before(node, pool.nodes) || !before(node, pool.nodes + kMaxNested)) {
+      delete node;
+      return;
+    }
+    pool.used &= ~(uint32_t(1) << (node - pool.nodes));
+  }
+
+  alignas(kCacheLineSize) std::atomic<Node*> tail_{nullptr};
+  // node of current holder, only touched by the holder
+  Node* holder_ = nullptr;
+};
+
+using TicketLockGuard = BasicSpinLockGuard<TicketLock>;
+using McsLockGuard = BasicSpinLockGuard<McsLock>;
+
+#endif  // CXXUTIL_QUEUE_LOCK_H_
@@ -0,0 +1,214 @@
+/**
+ * @file rcu.h
+ *
+ * This file contains a declaration of RcuDomain, an epoch-based read-copy-update domain,
+ * and RcuCell, a shared pointer-like cell for read-mostly state built on it.
+ */
+
+#ifndef CXXUTIL_RCU_H_
+#define CXXUTIL_RCU_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "spinlock.h"
+
+/**
+ * @brief Global epoch domain shared by all RcuCell
+ *
+ * Every reader thread owns a record on its own cache line. Entering a read section publishes the current global
+ * epoch in the record with a plain store plus a fence, leaving it stores 0, readers never do an atomic RMW.
+ * Synchronize() advances the global epoch and waits until no record is still inside a section entered before,
+ * after that nothing can reference memory unpublished before the call.
+ *
+ * Read sections nest. Synchronize() must not be called from inside a read section, it would wait for itself.
+ */
+class RcuDomain {
+ public:
+  static RcuDomain& Instance() {
+    // never destroyed, thread exit may touch it after static destruction
+    static RcuDomain* domain = new RcuDomain;
+    return *domain;
+  }
+
+  void ReadLock() {
+    Record* record = LocalRecord();
+    if (record->nesting++ == 0) {
+      record->epoch.store(global_epoch_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      // pairs with the fence in Synchronize: either the writer sees our epoch, or we see its new pointer
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+  }
+
+  void ReadUnlock() {
+    Record* record = LocalRecord();
+    if (--record->nesting == 0) record->epoch.store(0, std::memory_order_release);
+  }
+
+  /**
+   * @brief Wait for a grace period, all read sections running at the time of call have finished on return
+   */
+  void Synchronize() {
+    std::lock_guard<std::mutex> lk(sync_mutex_);
+    uint64_t epoch = global_epoch_.fetch_add(1, std::memory_order_seq_cst) + 1;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for (Record* record = records_.load(std::memory_order_acquire); record; record = record->next) {
+      uint32_t spin_count = 0;
+      for (;;) {
+        uint64_t e = record->epoch.load(std::memory_order_acquire);
+        if (e == 0 || e >= epoch) break;
+        if (++spin_count < kSpinCount) {
+          CpuRelax();
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    }
+  }
+
+ private:
+  static constexpr uint32_t kSpinCount = 1024;
+
+  struct alignas(kCacheLineSize) Record {
+    std::atomic<uint64_t> epoch{0};  // 0 means quiescent
+    uint32_t nesting = 0;
+    std::atomic<bool> in_use{true};
+    Record* next = nullptr;
+  };
+
+  // hands the record back for reuse when its thread exits
+  struct RecordHolder {
+    ~RecordHolder() {
+      if (record) record->in_use.store(false, std::memory_order_release);
+    }
+    Record* record = nullptr;
+  };
+
+  RcuDomain() = default;
+
+  Record* LocalRecord() {
+    static thread_local RecordHolder holder;
+    if (!holder.record) holder.record = AcquireRecord();
+    return holder.record;
+  }
+
+  Record* AcquireRecord() {
+    for (Record* record = records_.load(std::memory_order_acquire); record; record = record->next) {
+      bool expected = false;
+      if (!record->in_use.load(std::memory_order_relaxed) &&
+          record->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+        return record;
+      }
+    }
+    // records are never freed, a lock-free push is enough
+    Record* record = new Record;
+    Record* head = records_.load(std::memory_order_relaxed);
+    do {
+      record->next = head;
+    } while (!records_.compare_exchange_weak(head, record, std::memory_order_release, std::memory_order_relaxed));
+    return record;
+  }
+
+  RcuDomain(const RcuDomain&) = delete;
+  RcuDomain& operator=(const RcuDomain&) = delete;
+
+  alignas(kCacheLineSize) std::atomic<uint64_t> global_epoch_{1};
+  std::atomic<Record*> records_{nullptr};
+  std::mutex sync_mutex_;
+};  // RcuDomain
+
+class RcuReadGuard {
+ public:
+  RcuReadGuard() { RcuDomain::Instance().ReadLock(); }
+  ~RcuReadGuard() { RcuDomain::Instance().ReadUnlock(); }
+
+ private:
+  RcuReadGuard(const RcuReadGuard&) = delete;
+  RcuReadGuard& operator=(const RcuReadGuard&) = delete;
+};  // RcuReadGuard
+
+/**
+ * @brief Pointer to the current value of a RcuCell, keeps a read section open while alive
+ *
+ * Must be destroyed on the thread which created it.
+ */
+template <typename T>
+class RcuReadPtr {
+ public:
+  const T* get() const noexcept { return ptr_; }
+  const T& operator*() const noexcept { return *ptr_; }
+  const T* operator->() const noexcept { return ptr_; }
+  explicit operator bool() const noexcept { return ptr_ != nullptr; }
+
+ private:
+  template <typename U>
+  friend class RcuCell;
+
+  explicit RcuReadPtr(const std::atomic<T*>& ptr) : ptr_(ptr.load(std::memory_order_acquire)) {}
+
+  RcuReadPtr(const RcuReadPtr&) = delete;
+  RcuReadPtr& operator=(const RcuReadPtr&) = delete;
+
+  // declared first, the section is open before ptr_ is loaded
+  RcuReadGuard guard_;
+  const T* ptr_;
+};  // RcuReadPtr
+
+/**
+ * @brief Read-mostly value, readers never block and never write shared memory
+ *
+ * Writers publish a new copy and delete the old one after a grace period of the global RcuDomain,
+ * so an update costs a wait for the slowest reader. Updates of one cell are serialized.
+ */
+template <typename T>
+class RcuCell {
+ public:
+  RcuCell() : ptr_(new T) {}
+  explicit RcuCell(std::unique_ptr<T> value) : ptr_(value.release()) {}
+  template <typename... Args>
+  explicit RcuCell(std::in_place_t, Args&&... args) : ptr_(new T(std::forward<Args>(args)...)) {}
+  // caller makes sure no reader is left
+  ~RcuCell() { delete ptr_.load(std::memory_order_relaxed); }
+
+  RcuReadPtr<T> Read() const { return RcuReadPtr<T>(ptr_); }
+
+  /**
+   * @brief Publish value, returns after the old value has been reclaimed
+   */
+  void Store(std::unique_ptr<T> value) {
+    std::lock_guard<std::mutex> lk(writer_mutex_);
+    Publish(std::move(value));
+  }
+
+  void Store(const T& value) { Store(std::unique_ptr<T>(new T(value))); }
+
+  /**
+   * @brief Copy, modify with func(T&), publish
+   */
+  template <typename Func>
+  void Update(Func&& func) {
+    std::lock_guard<std::mutex> lk(writer_mutex_);
+    std::unique_ptr<T> value(new T(*ptr_.load(std::memory_order_relaxed)));
+    func(*value);
+    Publish(std::move(value));
+  }
+
+ private:
+  void Publish(std::unique_ptr<T> value) {
+    T* old = ptr_.exchange(value.release(), std::memory_order_acq_rel);
+    RcuDomain::Instance().Synchronize();
+    delete old;
+  }
+
+  RcuCell(const RcuCell&) = delete;
+  RcuCell& operator=(const RcuCell&) = delete;
+
+  std::atomic<T*> ptr_;
+  std::mutex writer_mutex_;
+};  // RcuCell
+
+#endif  // CXXUTIL_RCU_H_
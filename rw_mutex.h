@@ -20,136 +20,319 @@
 #ifndef __RW_MUTEX_HPP__
 #define __RW_MUTEX_HPP__
 
-#include <mutex>
-#include <condition_variable>
-
-class UniqueReadLock;
-class UniqueWriteLock;
-class UniqueRwLock;
-
-class RwMutex {
- public: RwMutex() noexcept = default; ~RwMutex() = default;
-  RwMutex(bool reader) noexcept : reader_(reader) {}
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include "futex.h"
+#include "lock_site.h"
+#include "spinlock.h"
+
+template <typename Mutex>
+class BasicUniqueReadLock;
+template <typename Mutex>
+class BasicUniqueWriteLock;
+template <typename Mutex>
+class BasicUniqueRwLock;
+template <typename LockType>
+class ProfiledLock;
+
+// Compile-time preference policies of BasicRwMutex
+// Reader preference: readers only wait for an active writer, writers may starve under a steady read load.
+struct ReaderPreference {
+  static constexpr bool kWriterFirst = false;
+};
+// Writer preference: readers also wait while any writer is waiting.
+struct WriterPreference {
+  static constexpr bool kWriterFirst = true;
+};
+
+// Reader-writer mutex built on one atomic state word.
+//
+// Uncontended ReadLock/WriteLock is one CAS, waiters spin for a while then park on futex.
+// Besides read and write there is an upgrade mode: at most one upgrade holder, which shares the mutex with readers
+// and excludes writers, so it can turn into a writer with Upgrade() without releasing the lock in between.
+// Downgrade() turns a writer back into a reader atomically.
+template <typename Preference = WriterPreference>
+class BasicRwMutex {
+ public:
+  BasicRwMutex() noexcept = default;
+  ~BasicRwMutex() = default;
 
   void ReadLock() { ReadLock(nullptr, nullptr); }
   void ReadUnlock() { ReadUnlock(nullptr, nullptr); }
   void WriteLock() { WriteLock(nullptr); }
   void WriteUnlock() { WriteUnlock(nullptr); }
 
-  bool Reading() { return reading_count_ > 0; }
-  bool Writing() { return writing_; }
-
-  friend class UniqueReadLock;
-  friend class UniqueWriteLock;
-  friend class UniqueRwLock;
+  void UpgradeLock() { UpgradeLock(nullptr); }
+  void UpgradeUnlock() { UpgradeUnlock(nullptr); }
+  // upgrade holder -> writer, waits for the other readers to leave
+  void Upgrade() { Upgrade(nullptr, nullptr); }
+  // writer -> reader
+  void Downgrade() { Downgrade(nullptr, nullptr, nullptr); }
+
+  bool Reading() { return (state_.load(std::memory_order_acquire) & kReaderMask) > 0; }
+  bool Writing() { return (state_.load(std::memory_order_acquire) & kWriter) != 0; }
+  bool Upgrading() { return (state_.load(std::memory_order_acquire) & kUpgrade) != 0; }
+
+  template <typename Mutex>
+  friend class BasicUniqueReadLock;
+  template <typename Mutex>
+  friend class BasicUniqueWriteLock;
+  template <typename Mutex>
+  friend class BasicUniqueRwLock;
+  // forwards the counting interface, so the guards above work with ProfiledLock<RwMutex> too
+  template <typename LockType>
+  friend class ProfiledLock;
 
  private:
-  void ReadLock(volatile size_t *count, volatile size_t *reading) {
-    std::unique_lock<std::mutex> lock(mutex_);
-    ++read_count_;
+  // state_: | writer (1 bit) | upgrade (1 bit) | waiting writers (14 bits) | readers (16 bits) |
+  // so at most 16383 threads wait to write and 65535 read holds are taken at once, past that a count carries into
+  // the field above it
+  static constexpr uint32_t kWriter = uint32_t(1) << 31;
+  static constexpr uint32_t kUpgrade = uint32_t(1) << 30;
+  static constexpr uint32_t kWaitingWriterOne = uint32_t(1) << 16;
+  static constexpr uint32_t kWaitingWriterMask = kUpgrade - kWaitingWriterOne;
+  static constexpr uint32_t kReaderMask = kWaitingWriterOne - 1;
+  static constexpr uint32_t kSpinCount = 128;
+
+  // bits which keep a new reader out, fixed by the policy
+  static constexpr uint32_t kReadBlocker = Preference::kWriterFirst ? (kWriter | kWaitingWriterMask) : kWriter;
+
+  static bool CanRead(uint32_t s) { return !(s & kReadBlocker); }
+  static bool CanUpgradeLock(uint32_t s) { return !(s & (kReadBlocker | kUpgrade)); }
+  static bool CanWrite(uint32_t s) { return !(s & (kWriter | kUpgrade | kReaderMask)); }
+
+  void ReadLock(size_t *count, size_t *reading) {
+    uint32_t s = state_.load(std::memory_order_relaxed);
+    if (!(CanRead(s) && state_.compare_exchange_weak(s, s + 1, std::memory_order_acquire,
+                                                     std::memory_order_relaxed))) {
+      ReadLockSlow();
+    }
     if (count) ++*count;
-    read_cv_.wait(lock, [this] () {
-        return (reader_ && !writing_) || (!reader_ && write_count_ == 0);
-      });
-    ++reading_count_;
     if (reading) ++*reading;
   }
 
-  void ReadUnlock(volatile size_t *count, volatile size_t *reading, bool release = false) {
-    std::unique_lock<std::mutex> lock(mutex_);
-    if (read_count_ == 0) return;
+  void ReadUnlock(size_t *count, size_t *reading, bool release = false) {
+    uint32_t n = 1;
     if (count) {
       if (*count == 0) return;
-      if (reading && *reading > *count) return;
-      if (release) {
-        if (read_count_ >= *count) {
-          read_count_ -= *count;
-        } else {
-          read_count_ = 0;
-        }
-        *count = 0;
-      } else {
-        --*count;
-        --read_count_;
-      }
-    } else {
-      --read_count_;
+      n = release ? static_cast<uint32_t>(*count) : 1;
+      *count -= n;
+    } else if ((state_.load(std::memory_order_relaxed) & kReaderMask) == 0) {
+      return;
     }
-    if (reading) {
-      if (release) {
-        if (reading_count_ >= *reading) {
-          reading_count_ -= *reading;
-        } else {
-          reading_count_ = 0;
-        }
-        *reading = 0;
+    if (reading) *reading = *reading > n ? *reading - n : 0;
+    uint32_t s = state_.fetch_sub(n, std::memory_order_seq_cst) - n;
+    if ((s & kReaderMask) == 0 && (s & kWaitingWriterMask)) {
+      // an upgrading holder waits among the writers, make sure it is not the one left asleep
+      if (s & kUpgrade) {
+        WakeWriters();
       } else {
-        if (*reading > 0) --*reading;
-        if (reading_count_ > 0) --reading_count_;
+        WakeWriter();
       }
-    } else {
-      if (reading_count_ > 0) --reading_count_;
     }
-    if (((reader_ &&  read_count_ == 0) || (!reader_ && reading_count_ == 0)) && write_count_ > 0) {
-      lock.unlock();
-      write_cv_.notify_one();
+  }
+
+  void WriteLock(size_t *count) {
+    uint32_t s = 0;
+    if (!state_.compare_exchange_strong(s, kWriter, std::memory_order_acquire, std::memory_order_relaxed)) {
+      WriteLockSlow();
     }
+    if (count) ++*count;
   }
 
-  void WriteLock(volatile size_t *count) {
-    std::unique_lock<std::mutex> lock(mutex_);
-    ++write_count_;
+  void WriteUnlock(size_t *count, bool release = false) {
+    if (count) {
+      if (*count == 0) return;
+      *count -= release ? *count : 1;
+    } else if (!(state_.load(std::memory_order_relaxed) & kWriter)) {
+      return;
+    }
+    uint32_t s = state_.fetch_and(~kWriter, std::memory_order_seq_cst) & ~kWriter;
+    if (s & kWaitingWriterMask) {
+      WakeWriter();
+      // with writer preference readers would block again behind the waiting writer
+      if (!Preference::kWriterFirst) WakeReaders();
+    } else {
+      WakeReaders();
+    }
+  }
+
+  void UpgradeLock(size_t *count) {
+    uint32_t s = state_.load(std::memory_order_relaxed);
+    if (!(CanUpgradeLock(s) && state_.compare_exchange_weak(s, s | kUpgrade, std::memory_order_acquire,
+                                                            std::memory_order_relaxed))) {
+      UpgradeLockSlow();
+    }
     if (count) ++*count;
-    write_cv_.wait(lock, [this] () {
-        return ((reader_ && read_count_ == 0) || (!reader_ && reading_count_ == 0)) && !writing_;
-      });
-    writing_ = true;
   }
 
-  void WriteUnlock(volatile size_t *count, bool release = false) {
-    std::unique_lock<std::mutex> lock(mutex_);
-    writing_ = false;
+  void UpgradeUnlock(size_t *count, bool release = false) {
     if (count) {
       if (*count == 0) return;
-      if (release) {
-        if (write_count_ >= *count) {
-          write_count_ -= *count;
-        } else {
-          write_count_ = 0;
+      *count -= release ? *count : 1;
+    } else if (!(state_.load(std::memory_order_relaxed) & kUpgrade)) {
+      return;
+    }
+    uint32_t s = state_.fetch_and(~kUpgrade, std::memory_order_seq_cst) & ~kUpgrade;
+    if ((s & kReaderMask) == 0 && (s & kWaitingWriterMask)) WakeWriter();
+    // other upgrade lockers wait together with readers
+    WakeReaders();
+  }
+
+  void Upgrade(size_t *upgrade_count, size_t *write_count) {
+    if (upgrade_count) {
+      if (*upgrade_count == 0) return;
+      --*upgrade_count;
+    }
+    // wait as a writer, with writer preference this also stops new readers
+    uint32_t s = state_.fetch_add(kWaitingWriterOne, std::memory_order_relaxed) + kWaitingWriterOne;
+    uint32_t spin_count = 0;
+    for (;;) {
+      if ((s & kReaderMask) == 0) {
+        if (state_.compare_exchange_weak(s, s - kUpgrade - kWaitingWriterOne + kWriter, std::memory_order_acquire,
+                                         std::memory_order_relaxed)) {
+          break;
         }
-        *count = 0;
+        continue;
+      }
+      if (spin_count < kSpinCount) {
+        ++spin_count;
+        CpuRelax();
       } else {
-        --*count;
-        --write_count_;
+        uint32_t seq = write_seq_.load(std::memory_order_acquire);
+        write_sleepers_.fetch_add(1, std::memory_order_seq_cst);
+        if (state_.load(std::memory_order_seq_cst) & kReaderMask) FutexWait(&write_seq_, seq);
+        write_sleepers_.fetch_sub(1, std::memory_order_relaxed);
       }
-    } else {
-      --write_count_;
+      s = state_.load(std::memory_order_relaxed);
     }
-    if ((reader_ && read_count_ > 0) || (!reader_ && write_count_== 0)) {
-      lock.unlock();
-      read_cv_.notify_all();
-    } else if (write_count_ > 0) {
-      lock.unlock();
-      write_cv_.notify_one();
+    if (write_count) ++*write_count;
+  }
+
+  void Downgrade(size_t *write_count, size_t *read_count, size_t *reading) {
+    if (write_count) {
+      if (*write_count == 0) return;
+      --*write_count;
     }
+    // writer bit off and one reader on in a single step, nobody can slip in between
+    state_.fetch_add(1 - kWriter, std::memory_order_seq_cst);
+    WakeReaders();
+    if (read_count) ++*read_count;
+    if (reading) ++*reading;
   }
 
-  RwMutex(const RwMutex &) = delete;
-  RwMutex &operator=(const RwMutex &) = delete;
+  void ReadLockSlow() {
+    uint32_t spin_count = 0;
+    for (;;) {
+      uint32_t s = state_.load(std::memory_order_relaxed);
+      if (CanRead(s)) {
+        if (state_.compare_exchange_weak(s, s + 1, std::memory_order_acquire, std::memory_order_relaxed)) return;
+        continue;
+      }
+      if (spin_count < kSpinCount) {
+        ++spin_count;
+        CpuRelax();
+        continue;
+      }
+      uint32_t seq = read_seq_.load(std::memory_order_acquire);
+      read_sleepers_.fetch_add(1, std::memory_order_seq_cst);
+      if (!CanRead(state_.load(std::memory_order_seq_cst))) FutexWait(&read_seq_, seq);
+      read_sleepers_.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
 
-  volatile bool reader_ = false;
-  volatile size_t read_count_ = 0;
-  volatile size_t write_count_ = 0;
-  volatile size_t reading_count_ = 0;
-  volatile bool writing_ = false;
-  std::mutex mutex_;
-  std::condition_variable read_cv_;
-  std::condition_variable write_cv_;
-};  // RwMutex
+  void UpgradeLockSlow() {
+    uint32_t spin_count = 0;
+    for (;;) {
+      uint32_t s = state_.load(std::memory_order_relaxed);
+      if (CanUpgradeLock(s)) {
+        if (state_.compare_exchange_weak(s, s | kUpgrade, std::memory_order_acquire, std::memory_order_relaxed)) {
+          return;
+        }
+        continue;
+      }
+      if (spin_count < kSpinCount) {
+        ++spin_count;
+        CpuRelax();
+        continue;
+      }
+      uint32_t seq = read_seq_.load(std::memory_order_acquire);
+      read_sleepers_.fetch_add(1, std::memory_order_seq_cst);
+      if (!CanUpgradeLock(state_.load(std::memory_order_seq_cst))) FutexWait(&read_seq_, seq);
+      read_sleepers_.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+
+  void WriteLockSlow() {
+    // register as waiting writer, with writer preference this holds back new readers
+    state_.fetch_add(kWaitingWriterOne, std::memory_order_relaxed);
+    uint32_t spin_count = 0;
+    for (;;) {
+      uint32_t s = state_.load(std::memory_order_relaxed);
+      if (CanWrite(s)) {
+        if (state_.compare_exchange_weak(s, s - kWaitingWriterOne + kWriter, std::memory_order_acquire,
+                                         std::memory_order_relaxed)) {
+          return;
+        }
+        continue;
+      }
+      if (spin_count < kSpinCount) {
+        ++spin_count;
+        CpuRelax();
+        continue;
+      }
+      uint32_t seq = write_seq_.load(std::memory_order_acquire);
+      write_sleepers_.fetch_add(1, std::memory_order_seq_cst);
+      if (!CanWrite(state_.load(std::memory_order_seq_cst))) FutexWait(&write_seq_, seq);
+      write_sleepers_.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+
+  // sleepers register before re-checking state_, so either they see the new state or we see them
+  void WakeReaders() {
+    if (read_sleepers_.load(std::memory_order_seq_cst) > 0) {
+      read_seq_.fetch_add(1, std::memory_order_release);
+      FutexWake(&read_seq_, INT32_MAX);
+    }
+  }
+
+  void WakeWriter() {
+    if (write_sleepers_.load(std::memory_order_seq_cst) > 0) {
+      write_seq_.fetch_add(1, std::memory_order_release);
+      FutexWake(&write_seq_, 1);
+    }
+  }
 
+  void WakeWriters() {
+    if (write_sleepers_.load(std::memory_order_seq_cst) > 0) {
+      write_seq_.fetch_add(1, std::memory_order_release);
+      FutexWake(&write_seq_, INT32_MAX);
+    }
+  }
+
+  BasicRwMutex(const BasicRwMutex &) = delete;
+  BasicRwMutex &operator=(const BasicRwMutex &) = delete;
+
+  std::atomic<uint32_t> state_{0};
+  std::atomic<uint32_t> read_seq_{0};
+  std::atomic<uint32_t> write_seq_{0};
+  std::atomic<uint32_t> read_sleepers_{0};
+  std::atomic<uint32_t> write_sleepers_{0};
+};  // BasicRwMutex
+
+using RwMutex = BasicRwMutex<WriterPreference>;
+using ReaderPreferRwMutex = BasicRwMutex<ReaderPreference>;
+
+template <typename Mutex = RwMutex>
 class ReadLockGuard {
  public:
-  explicit ReadLockGuard(RwMutex &mutex) noexcept : mutex_(mutex) {
+  explicit ReadLockGuard(Mutex &mutex, const char *file = __builtin_FILE(), int line = __builtin_LINE()) noexcept
+      : mutex_(mutex) {
+    SetLockSite(mutex_, file, line);
     mutex_.ReadLock();
   }
   ~ReadLockGuard() { mutex_.ReadUnlock(); }
@@ -158,12 +341,15 @@ class ReadLockGuard {
   ReadLockGuard(const ReadLockGuard &) = delete;
   ReadLockGuard &operator=(const ReadLockGuard &) = delete;
 
-  RwMutex &mutex_;
+  Mutex &mutex_;
 };  // ReadLockGuard
 
+template <typename Mutex = RwMutex>
 class WriteLockGuard {
  public:
-  explicit WriteLockGuard(RwMutex &mutex) noexcept : mutex_(mutex) {
+  explicit WriteLockGuard(Mutex &mutex, const char *file = __builtin_FILE(), int line = __builtin_LINE()) noexcept
+      : mutex_(mutex) {
+    SetLockSite(mutex_, file, line);
     mutex_.WriteLock();
   }
   ~WriteLockGuard() { mutex_.WriteUnlock(); }
@@ -172,24 +358,29 @@ class WriteLockGuard {
   WriteLockGuard(const WriteLockGuard &) = delete;
   WriteLockGuard &operator=(const WriteLockGuard &) = delete;
 
-  RwMutex &mutex_;
+  Mutex &mutex_;
 };  // WriteLockGuard
 
-class UniqueReadLock {
+// works with any mutex which provides the counting interface of RwMutex, e.g. BigReaderRwMutex
+template <typename Mutex>
+class BasicUniqueReadLock {
  public:
-  explicit UniqueReadLock(RwMutex &mutex, bool defer_lock = false) noexcept
+  explicit BasicUniqueReadLock(Mutex &mutex, bool defer_lock = false, const char *file = __builtin_FILE(),
+                               int line = __builtin_LINE()) noexcept
       : mutex_(std::addressof(mutex)), count_(0), reading_count_(0) {
-    if (!defer_lock) mutex_->ReadLock(&count_, &reading_count_);
+    if (!defer_lock) Lock(file, line);
+  }
+  ~BasicUniqueReadLock() {
+    if (mutex_) mutex_->ReadUnlock(&count_, &reading_count_, true);
   }
-  ~UniqueReadLock() { mutex_->ReadUnlock(&count_, &reading_count_, true); }
 
-  UniqueReadLock(UniqueReadLock &&lock) noexcept
+  BasicUniqueReadLock(BasicUniqueReadLock &&lock) noexcept
       : mutex_(lock.mutex_), count_(lock.count_), reading_count_(lock.reading_count_) {
     lock.mutex_ = nullptr;
     lock.count_ = 0;
     lock.reading_count_ = 0;
   }
-  UniqueReadLock &operator=(UniqueReadLock &&lock) noexcept {
+  BasicUniqueReadLock &operator=(BasicUniqueReadLock &&lock) noexcept {
     if (count_ > 0) mutex_->ReadUnlock(&count_, &reading_count_, true);
     std::swap(mutex_, lock.mutex_);
     std::swap(count_, lock.count_);
@@ -200,34 +391,43 @@ class UniqueReadLock {
     return *this;
   }
 
-  void Lock() { mutex_->ReadLock(&count_, &reading_count_); }
+  void Lock(const char *file = __builtin_FILE(), int line = __builtin_LINE()) {
+    SetLockSite(*mutex_, file, line);
+    mutex_->ReadLock(&count_, &reading_count_);
+  }
   void Unlock() { mutex_->ReadUnlock(&count_, &reading_count_); }
   bool Reading() { return mutex_->Reading(); }
 
  private:
-  UniqueReadLock() = delete;
-  UniqueReadLock(const UniqueReadLock &) = delete;
-  UniqueReadLock &operator=(const UniqueReadLock &) = delete;
+  BasicUniqueReadLock() = delete;
+  BasicUniqueReadLock(const BasicUniqueReadLock &) = delete;
+  BasicUniqueReadLock &operator=(const BasicUniqueReadLock &) = delete;
+
+  Mutex *mutex_ = nullptr;
+  size_t count_ = 0;
+  size_t reading_count_ = 0;
+};  // BasicUniqueReadLock
 
-  RwMutex *mutex_ = nullptr;
-  volatile size_t count_ = 0;
-  volatile size_t reading_count_ = 0;
-};  // UniqueReadLock
+using UniqueReadLock = BasicUniqueReadLock<RwMutex>;
 
-class UniqueWriteLock {
+template <typename Mutex>
+class BasicUniqueWriteLock {
  public:
-  explicit UniqueWriteLock(RwMutex &mutex, bool defer_lock = false) noexcept
+  explicit BasicUniqueWriteLock(Mutex &mutex, bool defer_lock = false, const char *file = __builtin_FILE(),
+                                int line = __builtin_LINE()) noexcept
       : mutex_(std::addressof(mutex)), count_(0) {
-    if (!defer_lock) mutex_->WriteLock(&count_);
+    if (!defer_lock) Lock(file, line);
+  }
+  ~BasicUniqueWriteLock() {
+    if (mutex_) mutex_->WriteUnlock(&count_, true);
   }
-  ~UniqueWriteLock() { mutex_->WriteUnlock(&count_, true); }
 
-  UniqueWriteLock(UniqueWriteLock &&lock) noexcept
+  BasicUniqueWriteLock(BasicUniqueWriteLock &&lock) noexcept
       : mutex_(lock.mutex_), count_(lock.count_) {
     lock.mutex_ = nullptr;
     lock.count_ = 0;
   }
-  UniqueWriteLock &operator=(UniqueWriteLock &&lock) noexcept {
+  BasicUniqueWriteLock &operator=(BasicUniqueWriteLock &&lock) noexcept {
     if (count_ > 0) mutex_->WriteUnlock(&count_, true);
     std::swap(mutex_, lock.mutex_);
     std::swap(count_, lock.count_);
@@ -236,75 +436,111 @@ class UniqueWriteLock {
     return *this;
   }
 
-  void Lock() { mutex_->WriteLock(&count_); }
+  void Lock(const char *file = __builtin_FILE(), int line = __builtin_LINE()) {
+    SetLockSite(*mutex_, file, line);
+    mutex_->WriteLock(&count_);
+  }
   void Unlock() { mutex_->WriteUnlock(&count_); }
   bool Writing() { return mutex_->Writing(); }
 
  private:
-  UniqueWriteLock() = delete;
-  UniqueWriteLock(const UniqueWriteLock &) = delete;
-  UniqueWriteLock &operator=(const UniqueWriteLock &) = delete;
+  BasicUniqueWriteLock() = delete;
+  BasicUniqueWriteLock(const BasicUniqueWriteLock &) = delete;
+  BasicUniqueWriteLock &operator=(const BasicUniqueWriteLock &) = delete;
 
-  RwMutex *mutex_ = nullptr;
-  volatile size_t count_ = 0;
-};  // UniqueWriteLock
+  Mutex *mutex_ = nullptr;
+  size_t count_ = 0;
+};  // BasicUniqueWriteLock
 
-class UniqueRwLock {
+using UniqueWriteLock = BasicUniqueWriteLock<RwMutex>;
+
+// holds the mutex in read, write or upgrade mode, Upgrade/Downgrade switch between them without unlocking
+template <typename Mutex>
+class BasicUniqueRwLock {
  public:
-  explicit UniqueRwLock(RwMutex &mutex, bool read_lock, bool defer_lock = false)
+  explicit BasicUniqueRwLock(Mutex &mutex, bool read_lock, bool defer_lock = false,
+                             const char *file = __builtin_FILE(), int line = __builtin_LINE())
       : mutex_(std::addressof(mutex)), read_count_(0), write_count_(0) {
     if (mutex_ && !defer_lock) {
       if (read_lock) {
-        mutex_->ReadLock(&read_count_, &reading_count_);
+        ReadLock(file, line);
       } else {
-        mutex_->WriteLock(&write_count_);
+        WriteLock(file, line);
       }
     }
   }
-  ~UniqueRwLock() {
+  ~BasicUniqueRwLock() {
+    if (!mutex_) return;
     mutex_->ReadUnlock(&read_count_, &reading_count_, true);
     mutex_->WriteUnlock(&write_count_, true);
+    mutex_->UpgradeUnlock(&upgrade_count_, true);
   }
 
-  UniqueRwLock(UniqueRwLock &&lock) noexcept
-      : mutex_(lock.mutex_), read_count_(lock.read_count_),
-        write_count_(lock.write_count_), reading_count_(lock.reading_count_) {
+  BasicUniqueRwLock(BasicUniqueRwLock &&lock) noexcept
+      : mutex_(lock.mutex_), read_count_(lock.read_count_), write_count_(lock.write_count_),
+        upgrade_count_(lock.upgrade_count_), reading_count_(lock.reading_count_) {
     lock.mutex_ = nullptr;
     lock.read_count_ = 0;
     lock.write_count_ = 0;
+    lock.upgrade_count_ = 0;
     lock.reading_count_ = 0;
   }
-  UniqueRwLock &operator=(UniqueRwLock &&lock) noexcept {
+  BasicUniqueRwLock &operator=(BasicUniqueRwLock &&lock) noexcept {
     if (read_count_ > 0) mutex_->ReadUnlock(&read_count_, &reading_count_, true);
     if (write_count_ > 0) mutex_->WriteUnlock(&write_count_, true);
+    if (upgrade_count_ > 0) mutex_->UpgradeUnlock(&upgrade_count_, true);
     std::swap(mutex_, lock.mutex_);
     std::swap(read_count_, lock.read_count_);
     std::swap(write_count_, lock.write_count_);
+    std::swap(upgrade_count_, lock.upgrade_count_);
     std::swap(reading_count_, lock.reading_count_);
     lock.mutex_ = nullptr;
     lock.read_count_ = 0;
     lock.write_count_ = 0;
+    lock.upgrade_count_ = 0;
     lock.reading_count_ = 0;
     return *this;
   }
 
-  void ReadLock() { mutex_->ReadLock(&read_count_, &reading_count_); }
+  void ReadLock(const char *file = __builtin_FILE(), int line = __builtin_LINE()) {
+    SetLockSite(*mutex_, file, line);
+    mutex_->ReadLock(&read_count_, &reading_count_);
+  }
   void ReadUnlock() { mutex_->ReadUnlock(&read_count_, &reading_count_); }
-  void WriteLock() { mutex_->WriteLock(&write_count_); }
+  void WriteLock(const char *file = __builtin_FILE(), int line = __builtin_LINE()) {
+    SetLockSite(*mutex_, file, line);
+    mutex_->WriteLock(&write_count_);
+  }
   void WriteUnlock() { mutex_->WriteUnlock(&write_count_); }
 
+  // upgrade mode is not recursive, lock it at most once per guard
+  void UpgradeLock(const char *file = __builtin_FILE(), int line = __builtin_LINE()) {
+    SetLockSite(*mutex_, file, line);
+    mutex_->UpgradeLock(&upgrade_count_);
+  }
+  void UpgradeUnlock() { mutex_->UpgradeUnlock(&upgrade_count_); }
+  void Upgrade(const char *file = __builtin_FILE(), int line = __builtin_LINE()) {
+    SetLockSite(*mutex_, file, line);
+    mutex_->Upgrade(&upgrade_count_, &write_count_);
+  }
+  void Downgrade() { mutex_->Downgrade(&write_count_, &read_count_, &reading_count_); }
+
   bool Reading() { return mutex_->Reading(); }
   bool Writing() { return mutex_->Writing(); }
+  bool Upgrading() { return mutex_->Upgrading(); }
 
  private:
-  UniqueRwLock() = delete;
-  UniqueRwLock(const UniqueRwLock &) = delete;
-  UniqueRwLock &operator=(const UniqueRwLock &) = delete;
-
-  RwMutex *mutex_ = nullptr;
-  volatile size_t read_count_ = 0;
-  volatile size_t write_count_ = 0;
-  volatile size_t reading_count_ = 0;
-};  // UniqueRwLock
+  BasicUniqueRwLock() = delete;
+  BasicUniqueRwLock(const BasicUniqueRwLock &) = delete;
+  BasicUniqueRwLock &operator=(const BasicUniqueRwLock &) = delete;
+
+  Mutex *mutex_ = nullptr;
+  size_t read_count_ = 0;
+  size_t write_count_ = 0;
+  size_t upgrade_count_ = 0;
+  size_t reading_count_ = 0;
+};  // BasicUniqueRwLock
+
+using UniqueRwLock = BasicUniqueRwLock<RwMutex>;
 
 #endif  //  __RW_MUTEX_HPP__
@@ -25,34 +25,49 @@
 #include <memory>
 #include <utility>
 
+#include "lock_site.h"
+
 class RwLock {
  public:
   RwLock() { pthread_rwlock_init(&rwlock_, NULL); }
   ~RwLock() { pthread_rwlock_destroy(&rwlock_); }
   void WriteLock() { pthread_rwlock_wrlock(&rwlock_); }
   void ReadLock() { pthread_rwlock_rdlock(&rwlock_); }
+  bool TryWriteLock() { return pthread_rwlock_trywrlock(&rwlock_) == 0; }
+  bool TryReadLock() { return pthread_rwlock_tryrdlock(&rwlock_) == 0; }
   void Unlock() { pthread_rwlock_unlock(&rwlock_); }
 
  private:
   pthread_rwlock_t rwlock_;
 };
 
+// guards are templated so that wrappers with RwLock interface (e.g. ProfiledLock<RwLock>) could be used
+template <typename LockType = RwLock>
 class RwLockWriteGuard {
  public:
-  explicit RwLockWriteGuard(RwLock& lock) : lock_(lock) { lock_.WriteLock(); }
+  explicit RwLockWriteGuard(LockType& lock, const char* file = __builtin_FILE(), int line = __builtin_LINE())
+      : lock_(lock) {
+    SetLockSite(lock_, file, line);
+    lock_.WriteLock();
+  }
   ~RwLockWriteGuard() { lock_.Unlock(); }
 
  private:
-  RwLock& lock_;
+  LockType& lock_;
 };
 
+template <typename LockType = RwLock>
 class RwLockReadGuard {
  public:
-  explicit RwLockReadGuard(RwLock& lock) : lock_(lock) { lock_.ReadLock(); }
+  explicit RwLockReadGuard(LockType& lock, const char* file = __builtin_FILE(), int line = __builtin_LINE())
+      : lock_(lock) {
+    SetLockSite(lock_, file, line);
+    lock_.ReadLock();
+  }
   ~RwLockReadGuard() { lock_.Unlock(); }
 
  private:
-  RwLock& lock_;
+  LockType& lock_;
 };
 
 #endif  // EDK_CXXUTIL_RWLOCK_H_
@@ -0,0 +1,140 @@
+/**
+ * @file seqlock.h
+ *
+ * This file contains a declaration of SeqLock, a sequence lock for small trivially copyable values,
+ * and AtomicStorage, the word-wise atomic storage it reads and writes through.
+ */
+
+#ifndef CXXUTIL_SEQLOCK_H_
+#define CXXUTIL_SEQLOCK_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+#include "spinlock.h"
+
+/**
+ * @brief Trivially copyable T kept in an array of relaxed atomic words
+ *
+ * A racy Load() returns a torn value instead of being undefined behaviour, which is what optimistic readers need.
+ * Ordering is left to the caller, see SeqLock.
+ */
+template <typename T>
+class AtomicStorage {
+  static_assert(std::is_trivially_copyable<T>::value, "AtomicStorage requires a trivially copyable type");
+
+ public:
+  static constexpr size_t kWordNum = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+  AtomicStorage() noexcept : AtomicStorage(T{}) {}
+  explicit AtomicStorage(const T& value) noexcept { Store(value); }
+
+  T Load() const noexcept {
+    uint64_t buf[kWordNum];
+    for (size_t i = 0; i < kWordNum; ++i) buf[i] = words_[i].load(std::memory_order_relaxed);
+    T value;
+    std::memcpy(&value, buf, sizeof(T));
+    return value;
+  }
+
+  void Store(const T& value) noexcept {
+    uint64_t buf[kWordNum] = {};
+    std::memcpy(buf, &value, sizeof(T));
+    for (size_t i = 0; i < kWordNum; ++i) words_[i].store(buf[i], std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<uint64_t> words_[kWordNum];
+};  // AtomicStorage
+
+/**
+ * @brief Sequence lock, readers never write shared memory and retry if a write overlapped
+ *
+ * Suits small values that are read far more often than written, such as a bounding box or a group of counters.
+ * Writers are serialized with a SpinLock, the sequence number is odd while a write is in progress.
+ * Readers keep retrying while writes overlap, so a steady stream of writes can starve them.
+ */
+template <typename T>
+class SeqLock {
+  static_assert(std::is_trivially_copyable<T>::value, "SeqLock requires a trivially copyable type");
+
+ public:
+  SeqLock() noexcept = default;
+  explicit SeqLock(const T& value) noexcept : data_(value) {}
+
+  /**
+   * @brief Get a consistent snapshot, spins while a writer is active
+   */
+  T Read() const noexcept {
+    T value;
+    uint32_t spin_count = 0;
+    while (!TryRead(&value)) {
+      // writer may have been preempted mid-write, stop burning its time slice
+      if (++spin_count < kSpinCount) {
+        CpuRelax();
+      } else {
+        std::this_thread::yield();
+      }
+    }
+    return value;
+  }
+
+  /**
+   * @brief Single optimistic attempt
+   * @return false if it raced with a writer, *value is unspecified then
+   */
+  bool TryRead(T* value) const noexcept {
+    uint32_t begin = seq_.load(std::memory_order_acquire);
+    if (begin & 1) return false;
+    *value = data_.Load();
+    // keep the data loads above the second sequence load
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return seq_.load(std::memory_order_relaxed) == begin;
+  }
+
+  void Write(const T& value) noexcept {
+    SpinLockGuard lk(writer_lock_);
+    WriteLocked(value);
+  }
+
+  /**
+   * @brief Read-modify-write under the writer lock, func gets a T& to modify
+   */
+  template <typename Func>
+  void Update(Func&& func) {
+    SpinLockGuard lk(writer_lock_);
+    T value = data_.Load();
+    func(value);
+    WriteLocked(value);
+  }
+
+  /**
+   * @brief Sequence number, changes on every write, odd while writing
+   */
+  uint32_t Sequence() const noexcept { return seq_.load(std::memory_order_acquire); }
+
+ private:
+  static constexpr uint32_t kSpinCount = 128;
+
+  void WriteLocked(const T& value) noexcept {
+    uint32_t seq = seq_.load(std::memory_order_relaxed);
+    seq_.store(seq + 1, std::memory_order_relaxed);
+    // keep the data stores below the odd sequence store
+    std::atomic_thread_fence(std::memory_order_release);
+    data_.Store(value);
+    seq_.store(seq + 2, std::memory_order_release);
+  }
+
+  SeqLock(const SeqLock&) = delete;
+  SeqLock& operator=(const SeqLock&) = delete;
+
+  alignas(kCacheLineSize) std::atomic<uint32_t> seq_{0};
+  AtomicStorage<T> data_;
+  SpinLock writer_lock_;
+};  // SeqLock
+
+#endif  // CXXUTIL_SEQLOCK_H_
@@ -2,16 +2,24 @@
 #ifndef CONNECT_H_
 #define CONNECT_H_
 
+#include <chrono>
+#include <condition_variable>
 #include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <sstream>
+#include <thread>
+#include <tuple>
 #include <vector>
 
+#include "delegate.h"
 #include "thread_pool.h"
 
 #define emit
 #define signals public
-#define connect(sender, signal, slot) ((sender)->signal.Bind(slot))
+// connect(sender, signal, func) or connect(sender, signal, receiver, &Receiver::Method)
+#define connect(sender, signal, ...) ((sender)->signal.Bind(__VA_ARGS__))
 
 enum class SignalPolicy {
   SYNC,
@@ -25,14 +33,17 @@ class SlotBase {
   void Run(RArgs&&... args) {
     static_cast<Derived*>(this)->Exec(std::forward<RArgs>(args)...);
   }
-  virtual ~SlotBase() = default;
+
+ protected:
+  // slots are stored by value in Signal, never deleted through the base
+  ~SlotBase() = default;
 };
 
 template<SignalPolicy policy, typename... Args>
 class Slot : public SlotBase<Slot<policy, Args...>> {
  public:
-  using OnFunc = std::function<void(Args...)>;
-  Slot(OnFunc&& func) noexcept : func_(std::forward<OnFunc>(func)) {}
+  using OnFunc = Delegate<void(Args...)>;
+  explicit Slot(OnFunc&& func) noexcept : func_(std::move(func)) {}
 
   template <typename... RArgs, typename = std::result_of<OnFunc(RArgs...)>>
   void Exec(RArgs&&... args) {
@@ -43,41 +54,236 @@ class Slot : public SlotBase<Slot<policy, Args...>> {
   OnFunc func_;
 };
 
+// how an async slot turns emits into tasks on its thread pool
+enum class EmitPolicy {
+  EACH,        // one task per emit
+  COALESCE,    // at most one task queued, only the latest value is delivered
+  BATCH,       // at most one task queued, slot receives all values emitted since last delivery
+  RATE_LIMIT   // like COALESCE, but deliveries are at least `interval` apart
+};
+
+struct EmitOptions {
+  EmitOptions() = default;
+  EmitOptions(EmitPolicy p, std::chrono::microseconds i = std::chrono::microseconds(0))  // NOLINT
+      : policy(p), interval(i) {}
+
+  EmitPolicy policy = EmitPolicy::EACH;
+  std::chrono::microseconds interval{0};
+};
+
+namespace detail {
+// one thread for the process, hands rate limited deliveries to their slot's pool once they are due
+class SlotTimer {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  static SlotTimer& Instance() {
+    // never destroyed, slots of static storage may schedule while the process exits
+    static SlotTimer* timer = new SlotTimer();
+    return *timer;
+  }
+
+  void Schedule(Clock::time_point when, std::function<void()> func) {
+    {
+      std::lock_guard<std::mutex> lk(mutex_);
+      tasks_.emplace(when, std::move(func));
+    }
+    cv_.notify_one();
+  }
+
+ private:
+  SlotTimer() { std::thread([this]() { Run(); }).detach(); }
+
+  void Run() {
+    std::unique_lock<std::mutex> lk(mutex_);
+    while (true) {
+      if (tasks_.empty()) {
+        cv_.wait(lk);
+        continue;
+      }
+      auto first = tasks_.begin();
+      if (Clock::now() < first->first) {
+        cv_.wait_until(lk, first->first);
+        continue;
+      }
+      std::function<void()> func = std::move(first->second);
+      tasks_.erase(first);
+      lk.unlock();
+      func();
+      lk.lock();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::multimap<Clock::time_point, std::function<void()>> tasks_;
+};
+}  // namespace detail
+
 template<typename... Args>
 class Slot<SignalPolicy::ASYNC, Args...> : public SlotBase<Slot<SignalPolicy::ASYNC, Args...>> {
  public:
-  using OnFunc = std::function<void(Args...)>;
-  Slot(const OnFunc& func) noexcept : func_(func) { tp_.Resize(1); }
+  using OnFunc = Delegate<void(Args...)>;
+  using ArgsTuple = std::tuple<typename std::decay<Args>::type...>;
+  using OnBatchFunc = Delegate<void(std::vector<ArgsTuple>)>;
+
+  explicit Slot(OnFunc&& func) : Slot(std::move(func), EmitOptions()) {}
+
+  // a BATCH slot needs a callable taking std::vector<ArgsTuple>, the other policies one taking Args...
+  template <typename F>
+  Slot(F&& func, EmitOptions options) : state_(std::make_shared<State>()) {
+    constexpr bool takes_batch = std::is_constructible<OnBatchFunc, F&&>::value;
+    constexpr bool takes_args = std::is_constructible<OnFunc, F&&>::value;
+    state_->options = options;
+    if (options.policy == EmitPolicy::BATCH && !takes_batch) {
+      LOG(ERROR) << "BATCH slot needs a callable taking std::vector<std::tuple<Args...>>, fallback to EACH";
+      state_->options.policy = EmitPolicy::EACH;
+    } else if (options.policy != EmitPolicy::BATCH && !takes_args) {
+      LOG(ERROR) << "slot callable only takes std::vector<std::tuple<Args...>>, fallback to BATCH";
+      state_->options.policy = EmitPolicy::BATCH;
+    }
+    SetFunc(std::forward<F>(func), state_->options.policy == EmitPolicy::BATCH);
+    tp_.reset(new EqualityThreadPool(nullptr, 1));
+    state_->pool = tp_.get();
+  }
+
+  Slot(Slot&&) noexcept = default;
+  Slot& operator=(Slot&&) = delete;
+
+  ~Slot() {
+    // moved from
+    if (!state_) return;
+    // a delivery still on the timer finds no pool and is dropped, the queued ones run before tp_ is gone
+    std::lock_guard<std::mutex> lk(state_->mutex);
+    state_->pool = nullptr;
+  }
 
   template <typename... RArgs, typename = std::result_of<OnFunc(RArgs...)>>
   void Exec(RArgs&&... args) {
-    tp_.VoidPush(0, func_, std::forward<RArgs>(args)...);
+    if (state_->options.policy == EmitPolicy::EACH) {
+      tp_->VoidPush(0, state_->func, std::forward<RArgs>(args)...);
+      return;
+    }
+
+    Clock::duration delay(0);
+    {
+      std::lock_guard<std::mutex> lk(state_->mutex);
+      if (state_->options.policy != EmitPolicy::BATCH) state_->pending.clear();
+      state_->pending.emplace_back(std::forward<RArgs>(args)...);
+      // a drain task is already queued or waiting on the timer, it will pick up this value
+      if (state_->scheduled) return;
+      state_->scheduled = true;
+      if (state_->options.policy == EmitPolicy::RATE_LIMIT) {
+        delay = state_->last_run + state_->options.interval - Clock::now();
+      }
+    }
+    if (delay > Clock::duration::zero()) {
+      // waits on the timer thread, the slot's thread stays free for the deliveries before
+      std::weak_ptr<State> weak = state_;
+      detail::SlotTimer::Instance().Schedule(Clock::now() + delay, [weak]() { PushDrain(weak.lock()); });
+      return;
+    }
+    std::shared_ptr<State> state = state_;
+    tp_->VoidPush(0, [state]() { Drain(state.get()); });
   }
 
  private:
-  EqualityThreadPool tp_;
-  OnFunc func_;
+  using Clock = std::chrono::steady_clock;
+
+  struct State {
+    OnFunc func;
+    OnBatchFunc batch_func;
+    EmitOptions options;
+    std::mutex mutex;
+    std::vector<ArgsTuple> pending;
+    bool scheduled = false;
+    Clock::time_point last_run;
+    // the slot's tp_, nullptr once the slot is being destroyed
+    EqualityThreadPool* pool = nullptr;
+  };
+
+  template <typename F>
+  void SetFunc(F&& func, bool batch) {
+    if constexpr (std::is_constructible<OnBatchFunc, F&&>::value && std::is_constructible<OnFunc, F&&>::value) {
+      if (batch) {
+        state_->batch_func = OnBatchFunc(std::forward<F>(func));
+      } else {
+        state_->func = OnFunc(std::forward<F>(func));
+      }
+    } else if constexpr (std::is_constructible<OnBatchFunc, F&&>::value) {
+      state_->batch_func = OnBatchFunc(std::forward<F>(func));
+    } else {
+      state_->func = OnFunc(std::forward<F>(func));
+    }
+  }
+
+  // runs in the timer thread, state is null if the slot is gone
+  static void PushDrain(std::shared_ptr<State> state) {
+    if (!state) return;
+    std::lock_guard<std::mutex> lk(state->mutex);
+    if (state->pool) state->pool->VoidPush(0, [state]() { Drain(state.get()); });
+  }
+
+  // runs in the slot's thread
+  static void Drain(State* state) {
+    std::vector<ArgsTuple> values;
+    {
+      std::lock_guard<std::mutex> lk(state->mutex);
+      values.swap(state->pending);
+      state->scheduled = false;
+      state->last_run = Clock::now();
+    }
+
+    if (state->options.policy == EmitPolicy::BATCH) {
+      state->batch_func(std::move(values));
+    } else if (!values.empty()) {
+      std::apply(state->func, values.back());
+    }
+  }
+
+  // shared with queued drain tasks, which may run after the slot has been moved
+  std::shared_ptr<State> state_;
+  // thread pool is not movable, hold it by pointer so that slot could be stored in vector
+  std::unique_ptr<EqualityThreadPool> tp_;
 };
 
 template<SignalPolicy policy, typename... Args>
 class Signal {
  public:
-  using SlotPtr = std::shared_ptr<SlotBase<Slot<policy, Args...>>>;
-  using OnFunc = std::function<void(Args...)>;
+  using SlotType = Slot<policy, Args...>;
+  using OnFunc = typename SlotType::OnFunc;
+
+  template <typename F>
+  void Bind(F&& func) {
+    slots_.emplace_back(OnFunc(std::forward<F>(func)));
+  }
+
+  template <typename C, typename Method>
+  void Bind(C* receiver, Method method) {
+    slots_.emplace_back(OnFunc(receiver, method));
+  }
+
+  // async signals only, e.g. connect(sender, signal, func, EmitOptions(EmitPolicy::COALESCE))
+  template <typename F>
+  void Bind(F&& func, EmitOptions options) {
+    slots_.emplace_back(std::forward<F>(func), options);
+  }
 
-  void Bind(OnFunc&& func) {
-    slots_.push_back(SlotPtr(new Slot<policy, Args...>(std::forward<OnFunc>(func))));
+  template <typename C, typename Method>
+  void Bind(C* receiver, Method method, EmitOptions options) {
+    slots_.emplace_back(OnFunc(receiver, method), options);
   }
 
   template <typename... RArgs, typename = std::result_of<OnFunc(RArgs...)>>
   void operator()(RArgs&&... args) {
-    for (auto& iter : slots_) {
-      iter->Run(std::forward<RArgs>(args)...);
+    for (auto& slot : slots_) {
+      slot.Run(std::forward<RArgs>(args)...);
     }
   }
 
  private:
-  std::vector<SlotPtr> slots_;
+  // slots are stored contiguously, emit walks one array without extra indirection
+  std::vector<SlotType> slots_;
 };
 
 template<typename... Args>
@@ -21,27 +21,157 @@
 /**
  * @file spinlock.h
  *
- * This file contains a declaration of the SpinLock class, and helper class SpinLockGuard.
+ * This file contains a declaration of the SpinLock class, its backoff policies, and helper class SpinLockGuard.
  */
 
 #ifndef CXXUTIL_SPIN_LOCK_H_
 #define CXXUTIL_SPIN_LOCK_H_
 
 #include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
 
+#include "futex.h"
+#include "lock_site.h"
+
+/// Padding unit to keep independently written atomics off each other's cache line
+constexpr std::size_t kCacheLineSize = 64;
 
 /**
- * @brief Spin lock implementation using atomic_flag and memory_order
+ * @brief Hint the cpu that caller is in a spin-wait loop
  */
-class SpinLock {
+inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+  asm volatile("yield" ::: "memory");
+#else
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+/**
+ * Backoff policies of BasicSpinLock.
+ *
+ * A policy object lives for one contended acquisition. `Spin()` is called each time the lock is observed busy,
+ * returning false means the waiter should park on a futex (only for policies with `kParks == true`).
+ */
+
+/// Busy-loop without any hint, the original test-and-test-and-set behaviour
+struct NoBackoff {
+  static constexpr bool kParks = false;
+  bool Spin() noexcept { return true; }
+};
+
+/// Spin with a pause instruction, releases pipeline resources to the sibling hyper-thread
+struct PauseBackoff {
+  static constexpr bool kParks = false;
+  bool Spin() noexcept {
+    CpuRelax();
+    return true;
+  }
+};
+
+/// Pause for exponentially growing rounds, reduces cache-coherence traffic under heavy contention
+struct ExponentialBackoff {
+  static constexpr bool kParks = false;
+  static constexpr uint32_t kMaxRounds = 1024;
+  bool Spin() noexcept {
+    for (uint32_t i = 0; i < rounds_; ++i) CpuRelax();
+    if (rounds_ < kMaxRounds) rounds_ <<= 1;
+    return true;
+  }
+
+ private:
+  uint32_t rounds_ = 1;
+};
+
+/// Pause for a while, then give up the timeslice, suits oversubscribed cpu
+struct YieldBackoff {
+  static constexpr bool kParks = false;
+  static constexpr uint32_t kSpinCount = 128;
+  bool Spin() noexcept {
+    if (count_ < kSpinCount) {
+      ++count_;
+      CpuRelax();
+    } else {
+      std::this_thread::yield();
+    }
+    return true;
+  }
+
+ private:
+  uint32_t count_ = 0;
+};
+
+/// Pause for a while, then park on futex until the holder unlocks
+struct ParkBackoff {
+  static constexpr bool kParks = true;
+  static constexpr uint32_t kSpinCount = 128;
+  bool Spin() noexcept {
+    if (count_ >= kSpinCount) return false;
+    ++count_;
+    CpuRelax();
+    return true;
+  }
+
+ private:
+  uint32_t count_ = 0;
+};
+
+/**
+ * @brief Spin lock implementation using atomic and memory_order
+ *
+ * @tparam Backoff Policy to wait while the lock is busy, see NoBackoff, PauseBackoff, ExponentialBackoff,
+ *                 YieldBackoff and ParkBackoff
+ */
+template <typename Backoff = PauseBackoff>
+class BasicSpinLock {
  public:
   /**
-   * @brief Lock the spinlock, blocks if the atomic_flag is not available
+   * @brief Lock the spinlock, blocks if the lock is not available
    */
   void Lock() {
+    if (TryLock()) return;
+    Backoff backoff;
     for (;;) {
-      if (!lock_.exchange(true, std::memory_order_acquire)) break;
-      while (lock_.load(std::memory_order_relaxed)) {}
+      while (state_.load(std::memory_order_relaxed) != kUnlocked) {
+        if (!backoff.Spin()) {
+          Park();
+          return;
+        }
+      }
+      if (TryLock()) return;
+    }
+  }
+
+  /**
+   * @brief Try to lock the spinlock once, never blocks
+   * @return true if lock is acquired
+   */
+  bool TryLock() {
+    int expected = kUnlocked;
+    return state_.load(std::memory_order_relaxed) == kUnlocked &&
+           state_.compare_exchange_strong(expected, kLocked, std::memory_order_acquire, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Try to lock the spinlock, blocks at most for timeout
+   * @return true if lock is acquired
+   */
+  template <typename Rep, typename Period>
+  bool TryLockFor(const std::chrono::duration<Rep, Period>& timeout) {
+    if (TryLock()) return true;
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    Backoff backoff;
+    for (;;) {
+      while (state_.load(std::memory_order_relaxed) != kUnlocked) {
+        if (!backoff.Spin()) return ParkUntil(deadline);
+        if (std::chrono::steady_clock::now() >= deadline) return false;
+      }
+      if (TryLock()) return true;
     }
   }
 
@@ -49,7 +179,11 @@ class SpinLock {
    * @brief Unlock the spinlock
    */
   void Unlock() {
-    lock_.store(false, std::memory_order_release);
+    if (Backoff::kParks) {
+      if (state_.exchange(kUnlocked, std::memory_order_release) == kContended) FutexWake(&state_, 1);
+    } else {
+      state_.store(kUnlocked, std::memory_order_release);
+    }
   }
 
   /**
@@ -57,23 +191,48 @@ class SpinLock {
    * @return ture if is locked
    */
   bool IsLocked() const {
-    return lock_.load(std::memory_order_acquire);
+    return state_.load(std::memory_order_acquire) != kUnlocked;
   }
 
  private:
-  std::atomic<bool> lock_{false};
+  static constexpr int kUnlocked = 0;
+  static constexpr int kLocked = 1;
+  // locked and there may be threads parked on futex, only used by parking policies
+  static constexpr int kContended = 2;
+
+  void Park() {
+    while (state_.exchange(kContended, std::memory_order_acquire) != kUnlocked) {
+      FutexWait(&state_, kContended);
+    }
+  }
+
+  bool ParkUntil(std::chrono::steady_clock::time_point deadline) {
+    while (state_.exchange(kContended, std::memory_order_acquire) != kUnlocked) {
+      if (!FutexWaitFor(&state_, kContended, deadline - std::chrono::steady_clock::now())) return false;
+    }
+    return true;
+  }
+
+  std::atomic<int> state_{kUnlocked};
 };
 
+using SpinLock = BasicSpinLock<>;
+
 /**
  * @brief Spin lock helper class, provide RAII management
  */
-class SpinLockGuard {
+template <typename LockType>
+class BasicSpinLockGuard {
  public:
   /**
    * Constructor, lock the spinlock in construction
    * @param lock Spin lock instance.
+   * @param file, line Call site, recorded by a profiled lock
    */
-  explicit SpinLockGuard(SpinLock &lock) : lock_(lock) {  // NOLINT
+  explicit BasicSpinLockGuard(LockType &lock, const char *file = __builtin_FILE(),  // NOLINT
+                              int line = __builtin_LINE())
+      : lock_(lock) {
+    SetLockSite(lock_, file, line);
     lock_.Lock();
     is_locked.store(true, std::memory_order_release);
   }
@@ -81,8 +240,9 @@ class SpinLockGuard {
   /**
    * @brief Lock the spinlock if have not been locked by this guard
    */
-  void Lock() {
+  void Lock(const char *file = __builtin_FILE(), int line = __builtin_LINE()) {
     if (!is_locked.load(std::memory_order_consume)) {
+      SetLockSite(lock_, file, line);
       lock_.Lock();
       is_locked.store(true, std::memory_order_release);
     }
@@ -101,15 +261,17 @@ class SpinLockGuard {
   /**
    * Destructor, unlock the spinlock in destruction
    */
-  ~SpinLockGuard() {
+  ~BasicSpinLockGuard() {
     if (is_locked.load(std::memory_order_consume)) {
       lock_.Unlock();
     }
   }
 
  private:
-  SpinLock &lock_;
+  LockType &lock_;
   std::atomic<bool> is_locked{false};
 };
 
+using SpinLockGuard = BasicSpinLockGuard<SpinLock>;
+
 #endif  // CXXUTIL_SPIN_LOCK_H_
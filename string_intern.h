@@ -0,0 +1,159 @@
+/**
+ * @file string_intern.h
+ *
+ * This file contains a declaration of StringArena, StringPool and InternedString, a string interning pool whose
+ * characters live in an arena, and aliases of string-keyed maps with allocation-free `std::string_view` lookup.
+ */
+
+#ifndef CXXUTIL_STRING_INTERN_H_
+#define CXXUTIL_STRING_INTERN_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "flat_hash_map.h"
+
+/**
+ * @brief Bump allocator for string bytes, memory is released all at once on destruction
+ */
+class StringArena {
+ public:
+  static constexpr size_t kBlockSize = 64 * 1024;
+
+  StringArena() = default;
+
+  /**
+   * @brief Copy str into the arena, the copy is NUL terminated and lives as long as the arena
+   */
+  std::string_view Store(std::string_view str) {
+    const size_t size = str.size() + 1;
+    char* dst;
+    if (size > kBlockSize / 4) {
+      // a big string gets a block of its own, the current block keeps serving small ones
+      blocks_.emplace_back(new char[size]);
+      dst = blocks_.back().get();
+    } else {
+      if (size > left_) {
+        blocks_.emplace_back(new char[kBlockSize]);
+        cursor_ = blocks_.back().get();
+        left_ = kBlockSize;
+      }
+      dst = cursor_;
+      cursor_ += size;
+      left_ -= size;
+    }
+    std::memcpy(dst, str.data(), str.size());
+    dst[str.size()] = '\0';
+    used_ += size;
+    return std::string_view(dst, str.size());
+  }
+
+  /// bytes handed out, including terminators
+  size_t Used() const noexcept { return used_; }
+  size_t BlockNumber() const noexcept { return blocks_.size(); }
+
+ private:
+  StringArena(const StringArena&) = delete;
+  StringArena& operator=(const StringArena&) = delete;
+
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  char* cursor_ = nullptr;
+  size_t left_ = 0;
+  size_t used_ = 0;
+};  // StringArena
+
+/**
+ * @brief Handle of a string interned in a StringPool
+ *
+ * Equal strings of one pool share a handle, so comparison and hashing work on the pointer only.
+ * A default constructed handle is null and compares unequal to every interned string.
+ */
+class InternedString {
+ public:
+  InternedString() = default;
+
+  std::string_view View() const noexcept { return data_ ? std::string_view(data_, size_) : std::string_view(); }
+  const char* CStr() const noexcept { return data_ ? data_ : ""; }
+  size_t Size() const noexcept { return size_; }
+  explicit operator bool() const noexcept { return data_ != nullptr; }
+
+  friend bool operator==(InternedString a, InternedString b) noexcept { return a.data_ == b.data_; }
+  friend bool operator!=(InternedString a, InternedString b) noexcept { return a.data_ != b.data_; }
+
+ private:
+  friend class StringPool;
+  friend struct std::hash<InternedString>;
+
+  explicit InternedString(std::string_view str) : data_(str.data()), size_(str.size()) {}
+
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+};  // InternedString
+
+namespace std {
+template <>
+struct hash<InternedString> {
+  size_t operator()(InternedString str) const noexcept { return std::hash<const char*>{}(str.data_); }
+};
+}  // namespace std
+
+/**
+ * @brief Interning pool, one arena copy per distinct string
+ *
+ * The index is a FlatHashMap keyed by views into the arena, so interning allocates only when the arena or the index
+ * grows, and lookups by `std::string_view` never allocate. Not thread safe.
+ */
+class StringPool {
+ public:
+  StringPool() = default;
+
+  /**
+   * @brief Handle of str, copied into the pool on first sight
+   */
+  InternedString Intern(std::string_view str) {
+    auto it = index_.find(str);
+    if (it != index_.end()) return it->second;
+    InternedString handle(arena_.Store(str));
+    index_.try_emplace(handle.View(), handle);
+    return handle;
+  }
+
+  /**
+   * @brief Handle of str if it has been interned, null handle otherwise
+   */
+  InternedString Find(std::string_view str) const {
+    auto it = index_.find(str);
+    return it == index_.end() ? InternedString() : it->second;
+  }
+
+  size_t Size() const noexcept { return index_.size(); }
+  const StringArena& Arena() const noexcept { return arena_; }
+
+ private:
+  StringPool(const StringPool&) = delete;
+  StringPool& operator=(const StringPool&) = delete;
+
+  StringArena arena_;
+  FlatHashMap<std::string_view, InternedString> index_;
+};  // StringPool
+
+/// Map keyed by interned handles, a lookup hashes and compares one pointer
+template <typename Value>
+using InternedMap = FlatHashMap<InternedString, Value>;
+
+/// std::map with transparent comparator, find / count by `std::string_view` or `const char*` build no std::string
+template <typename Value>
+using StringMap = std::map<std::string, Value, std::less<>>;
+
+/// Hash map with transparent string lookup, std::unordered_map only gets heterogeneous lookup in C++20
+template <typename Value>
+using StringHashMap = FlatHashMap<std::string, Value>;
+
+#endif  // CXXUTIL_STRING_INTERN_H_
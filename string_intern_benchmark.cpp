@@ -0,0 +1,70 @@
+// string interning benchmarks, a binary of their own as they count allocations through a replaced global
+// operator new, which would slow down every other benchmark
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#include "benchmark_string_intern.h"
+
+// allocations of the calling thread, benchmarks report the difference over their loop. Thread-local, so counting
+// stays off the shared cache lines of the multithreaded benchmarks
+thread_local int64_t g_allocation_count = 0;
+
+namespace {
+void* CountedAlloc(size_t size) {
+  ++g_allocation_count;
+  return std::malloc(size ? size : 1);
+}
+
+void* CountedAlignedAlloc(size_t size, std::align_val_t align) {
+  ++g_allocation_count;
+  const size_t alignment = static_cast<size_t>(align);
+  // aligned_alloc wants a non-zero multiple of the alignment
+  const size_t rounded = size ? (size + alignment - 1) / alignment * alignment : alignment;
+  return std::aligned_alloc(alignment, rounded);
+}
+}  // namespace
+
+void* operator new(size_t size) {
+  if (void* p = CountedAlloc(size)) return p;
+  throw std::bad_alloc();
+}
+void* operator new[](size_t size) {
+  if (void* p = CountedAlloc(size)) return p;
+  throw std::bad_alloc();
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return CountedAlloc(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return CountedAlloc(size); }
+
+// FlatHashMap and other over-aligned types come here
+void* operator new(size_t size, std::align_val_t align) {
+  if (void* p = CountedAlignedAlloc(size, align)) return p;
+  throw std::bad_alloc();
+}
+void* operator new[](size_t size, std::align_val_t align) {
+  if (void* p = CountedAlignedAlloc(size, align)) return p;
+  throw std::bad_alloc();
+}
+void* operator new(size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+  return CountedAlignedAlloc(size, align);
+}
+void* operator new[](size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+  return CountedAlignedAlloc(size, align);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+
+BENCHMARK_MAIN();
@@ -5,3 +5,13 @@ void PrintIntTypeAddress() {
   int i_a;
   a.PrintTypeAddress(i_a);
 }
+
+namespace {
+struct LocalItem {
+  int value;
+};
+}  // namespace
+
+any MakeFooItemAny(int id) { return any(FooItem{id, "foo item " + std::to_string(id)}); }
+
+any MakeFooLocalAny() { return any(LocalItem{42}); }
@@ -1,12 +1,28 @@
 #pragma once
 
 #include <iostream>
+#include <string>
+
+#include "any.h"
+
+// libfoo is built with hidden visibility, only what is marked here is exported
+#define FOO_EXPORT __attribute__((visibility("default")))
 
 template <typename T>
 class TypeInfo {
 };
 
-void PrintIntTypeAddress();
+FOO_EXPORT void PrintIntTypeAddress();
+
+struct FooItem {
+  int id;
+  std::string name;
+};
+
+// an any made inside libfoo, whose vtable of FooItem is its own copy
+FOO_EXPORT any MakeFooItemAny(int id);
+// an any holding a type of an anonymous namespace of libfoo
+FOO_EXPORT any MakeFooLocalAny();
 
 class aContainer {
  public:
@@ -0,0 +1,118 @@
+/**
+ * @file xxhash.h
+ *
+ * This file contains a declaration of Xxh64, the 64-bit xxHash, one-shot or fed piece by piece.
+ */
+
+#ifndef CXXUTIL_XXHASH_H_
+#define CXXUTIL_XXHASH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * @brief Streaming XXH64, gives the same digest as the reference implementation for the same bytes and seed
+ *
+ * Not cryptographic, made to detect corruption at memory bandwidth, e.g. of a file while it is being downloaded.
+ */
+class Xxh64 {
+ public:
+  explicit Xxh64(uint64_t seed = 0) : seed_(seed) {
+    acc_[0] = seed + kPrime1 + kPrime2;
+    acc_[1] = seed + kPrime2;
+    acc_[2] = seed;
+    acc_[3] = seed - kPrime1;
+  }
+
+  void Update(const void* data, size_t len) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    const uint8_t* const end = p + len;
+    total_len_ += len;
+
+    if (buffered_ + len < kStripe) {
+      std::memcpy(buffer_ + buffered_, p, len);
+      buffered_ += len;
+      return;
+    }
+    if (buffered_) {
+      const size_t fill = kStripe - buffered_;
+      std::memcpy(buffer_ + buffered_, p, fill);
+      Consume(buffer_);
+      p += fill;
+      buffered_ = 0;
+    }
+    for (; end - p >= static_cast<ptrdiff_t>(kStripe); p += kStripe) Consume(p);
+    buffered_ = end - p;
+    std::memcpy(buffer_, p, buffered_);
+  }
+
+  uint64_t Digest() const {
+    uint64_t h;
+    if (total_len_ >= kStripe) {
+      h = Rotl(acc_[0], 1) + Rotl(acc_[1], 7) + Rotl(acc_[2], 12) + Rotl(acc_[3], 18);
+      for (uint64_t acc : acc_) h = (h ^ Round(0, acc)) * kPrime1 + kPrime4;
+    } else {
+      h = seed_ + kPrime5;
+    }
+    h += total_len_;
+
+    const uint8_t* p = buffer_;
+    const uint8_t* const end = buffer_ + buffered_;
+    for (; end - p >= 8; p += 8) h = Rotl(h ^ Round(0, Read64(p)), 27) * kPrime1 + kPrime4;
+    if (end - p >= 4) {
+      h = Rotl(h ^ (Read32(p) * kPrime1), 23) * kPrime2 + kPrime3;
+      p += 4;
+    }
+    for (; p < end; ++p) h = Rotl(h ^ (*p * kPrime5), 11) * kPrime1;
+
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+  }
+
+  static uint64_t Hash(const void* data, size_t len, uint64_t seed = 0) {
+    Xxh64 hasher(seed);
+    hasher.Update(data, len);
+    return hasher.Digest();
+  }
+
+ private:
+  static constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ull;
+  static constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4Full;
+  static constexpr uint64_t kPrime3 = 0x165667B19E3779F9ull;
+  static constexpr uint64_t kPrime4 = 0x85EBCA77C2B2AE63ull;
+  static constexpr uint64_t kPrime5 = 0x27D4EB2F165667C5ull;
+  // four lanes of 8 bytes
+  static constexpr size_t kStripe = 32;
+
+  static uint64_t Rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+  static uint64_t Round(uint64_t acc, uint64_t input) { return Rotl(acc + input * kPrime2, 31) * kPrime1; }
+
+  // little-endian hosts, as everywhere this code runs
+  static uint64_t Read64(const uint8_t* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+  }
+  static uint64_t Read32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+  }
+
+  void Consume(const uint8_t* stripe) {
+    for (int i = 0; i < 4; ++i) acc_[i] = Round(acc_[i], Read64(stripe + 8 * i));
+  }
+
+  uint64_t seed_;
+  uint64_t acc_[4];
+  uint64_t total_len_ = 0;
+  uint8_t buffer_[kStripe];
+  size_t buffered_ = 0;
+};  // Xxh64
+
+#endif  // CXXUTIL_XXHASH_H_